@@ -0,0 +1,249 @@
+#include "headers\Autotune.h"
+#include "headers\TileScheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifndef _MSC_VER
+#include <cpuid.h>
+#endif
+
+#define PROFILE_HEADER "FastNoise kernel profile 1"
+
+#ifdef USEGATHER
+static const KernelConfig defaultConfig = { KERNEL_UNROLL, 1, DEFAULT_GRAIN, 0 };
+#endif
+#ifndef USEGATHER
+static const KernelConfig defaultConfig = { KERNEL_UNROLL, 0, DEFAULT_GRAIN, 0 };
+#endif
+//Every SetKernelConfig publishes a new config, generators may still be reading the old
+//one so it is never freed. They are a few bytes and set a handful of times per process.
+static std::atomic<const KernelConfig*> config(&defaultConfig);
+static std::mutex setLock;
+static std::once_flag profileOnce;
+
+const KernelConfig* CurrentKernelConfig()
+{
+	std::call_once(profileOnce, [] {
+		const char* path = getenv(PROFILE_ENV);
+		if (path && *path) LoadKernelProfile(path);
+	});
+	return config.load(std::memory_order_acquire);
+}
+
+void GetKernelConfig(KernelConfig* result)
+{
+	*result = *CurrentKernelConfig();
+	result->grain = GetSchedulerGrain();
+}
+
+void SetKernelConfig(const KernelConfig* c)
+{
+	std::lock_guard<std::mutex> guard(setLock);
+	KernelConfig* next = new KernelConfig(*c);
+	if (next->unroll < 1 || next->unroll > KERNEL_UNROLL || KERNEL_UNROLL % next->unroll != 0) next->unroll = KERNEL_UNROLL;
+	if (next->grain < 1) next->grain = DEFAULT_GRAIN;
+	if (next->threads < 0) next->threads = 0;
+	config.store(next, std::memory_order_release);
+	SetSchedulerGrain(next->grain);
+	int workers = next->threads > 0 ? next->threads : (int)std::thread::hardware_concurrency();
+	SetSchedulerThreads(next->threads);
+	if (workers > 0 && workers != GetSchedulerThreads()) RestartScheduler();
+}
+
+//cpu model string, profiles are only valid on the model they were made on
+static void cpuBrand(char* brand)
+{
+	unsigned int regs[12];
+	memset(regs, 0, sizeof(regs));
+	for (unsigned int i = 0; i < 3; i++)
+	{
+#ifdef _MSC_VER
+		__cpuid((int*)&regs[i * 4], 0x80000002 + i);
+#endif
+#ifndef _MSC_VER
+		__get_cpuid(0x80000002 + i, &regs[i * 4], &regs[i * 4 + 1], &regs[i * 4 + 2], &regs[i * 4 + 3]);
+#endif
+	}
+	memcpy(brand, regs, sizeof(regs));
+	brand[sizeof(regs)] = 0;
+	//some models pad the front with spaces, and the line must not contain newlines
+	char* start = brand;
+	while (*start == ' ') start++;
+	memmove(brand, start, strlen(start) + 1);
+	for (char* c = brand; *c; c++) if (*c == '\n' || *c == '\r') *c = ' ';
+}
+
+static bool saveProfile(const char* path, const KernelConfig* c)
+{
+	char brand[49];
+	cpuBrand(brand);
+	FILE* f = fopen(path, "w");
+	if (!f) return false;
+	fprintf(f, "%s\ncpu %s\nvector %d\nkernelunroll %d\nunroll %d\ngather %d\ngrain %d\nthreads %d\n",
+		PROFILE_HEADER, brand, VECTOR_SIZE, KERNEL_UNROLL, c->unroll, c->gather, c->grain, c->threads);
+	return fclose(f) == 0;
+}
+
+bool LoadKernelProfile(const char* path)
+{
+	FILE* f = fopen(path, "r");
+	if (!f) return false;
+	char line[128], brand[49];
+	cpuBrand(brand);
+	KernelConfig c = *config.load(std::memory_order_acquire);
+	int vector = 0, kernelUnroll = 0, fields = 0;
+	bool header = false, sameCpu = false;
+	while (fgets(line, sizeof(line), f))
+	{
+		line[strcspn(line, "\r\n")] = 0;
+		if (!strcmp(line, PROFILE_HEADER)) header = true;
+		else if (!strncmp(line, "cpu ", 4)) sameCpu = !strcmp(line + 4, brand);
+		else if (sscanf(line, "vector %d", &vector) == 1) continue;
+		else if (sscanf(line, "kernelunroll %d", &kernelUnroll) == 1) continue;
+		else if (sscanf(line, "unroll %d", &c.unroll) == 1) fields++;
+		else if (sscanf(line, "gather %d", &c.gather) == 1) fields++;
+		else if (sscanf(line, "grain %d", &c.grain) == 1) fields++;
+		else if (sscanf(line, "threads %d", &c.threads) == 1) fields++;
+	}
+	fclose(f);
+	//a profile from another cpu or another build would pick the wrong variants
+	if (!header || !sameCpu || vector != VECTOR_SIZE || kernelUnroll != KERNEL_UNROLL || fields != 4) return false;
+	SetKernelConfig(&c);
+	return true;
+}
+
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Best of two runs of noise over count groups of KERNEL_UNROLL vectors
+static double timeKernel(ISIMDNoise3dN noise, const SIMD* x, const SIMD* y, const SIMD* z, SIMD* out, int count)
+{
+	double best = 1e30;
+	for (int run = 0; run < 2; run++)
+	{
+		double start = now();
+		for (int i = 0; i < count; i += KERNEL_UNROLL) noise(out + i, x + i, y + i, z + i);
+		double t = now() - start;
+		if (t < best) best = t;
+	}
+	return best;
+}
+
+//Best of two sphere maps with the current configuration
+static double timeMap(const NoiseParams* P, float* result, int width, int height)
+{
+	float min, max;
+	double best = 1e30;
+	for (int run = 0; run < 2; run++)
+	{
+		double start = now();
+		FillSphereSurfaceTileSIMD(result, P, width, height, 0, 0, width, height, &min, &max);
+		double t = now() - start;
+		if (t < best) best = t;
+	}
+	return best;
+}
+
+//Tries every kernel variant on a fixed set of coordinates, then grains and thread
+//counts on a small sphere map, keeping the fastest of each in that order. Sizes are
+//kept to a few milliseconds in all, enough to separate variants that differ by 10%.
+bool AutotuneKernels(const char* profilePath, KernelConfig* result)
+{
+	KernelConfig best;
+	GetKernelConfig(&best);
+
+	//kernels, the noise score is Perlin and simplex together. Simplex has no unroll
+	//variants, so it is timed once per gather setting.
+	const int count = 256 * KERNEL_UNROLL;
+	SIMD* coords = (SIMD*)_aligned_malloc(4 * count * sizeof(SIMD), MEMORY_ALIGNMENT);
+	float* c = (float*)coords;
+	uint32_t h = 12345;
+	for (int i = 0; i < 3 * count * VECTOR_SIZE; i++)
+	{
+		h = h * 1664525 + 1013904223;
+		c[i] = (h >> 8) * (64.0f / 16777216.0f);
+	}
+	initSIMDSimplex();
+	double bestTime = 1e30;
+#ifdef USEGATHER
+	int gathers = 2;
+#endif
+#ifndef USEGATHER
+	int gathers = 1;
+#endif
+	for (int gather = 0; gather < gathers; gather++)
+	{
+		double simplex = timeKernel(SelectNoiseKernelN(SIMPLEX, KERNEL_UNROLL, gather != 0), coords, coords + count, coords + 2 * count, coords + 3 * count, count);
+		for (int unroll = 1; unroll <= KERNEL_UNROLL; unroll *= 2)
+		{
+			if (KERNEL_UNROLL % unroll != 0) continue;
+			double t = timeKernel(SelectNoiseKernelN(PERLIN, unroll, gather != 0), coords, coords + count, coords + 2 * count, coords + 3 * count, count) + simplex;
+			if (t < bestTime)
+			{
+				bestTime = t;
+				best.unroll = unroll;
+				best.gather = gather;
+			}
+		}
+	}
+	_aligned_free(coords);
+	SetKernelConfig(&best);
+
+	//grain, then threads on a map big enough to give every worker several chunks
+	NoiseParams P = { 2, 2.0f, 2.0f, 0.5f, 1.0f, FBM, PERLIN, 0, QUALITY_REFERENCE };
+	const int width = 256, height = 128;
+	float* map = (float*)_aligned_malloc(width*height*sizeof(float), MEMORY_ALIGNMENT);
+	float min, max;
+	FillSphereSurfaceTileSIMD(map, &P, width, height, 0, 0, width, height, &min, &max);
+	int grains[] = { 4, 8, 16 };
+	bestTime = 1e30;
+	int bestGrain = best.grain;
+	for (int i = 0; i < 3; i++)
+	{
+		SetSchedulerGrain(grains[i]);
+		double t = timeMap(&P, map, width, height);
+		if (t < bestTime)
+		{
+			bestTime = t;
+			bestGrain = grains[i];
+		}
+	}
+	best.grain = bestGrain;
+	SetSchedulerGrain(bestGrain);
+
+	int hardware = (int)std::thread::hardware_concurrency();
+	if (hardware > 1)
+	{
+		int candidates[] = { hardware, hardware / 2 };
+		bestTime = 1e30;
+		int bestThreads = 0;
+		for (int i = 0; i < 2; i++)
+		{
+			if (candidates[i] < 1 || (i > 0 && candidates[i] == candidates[i - 1])) continue;
+			SetSchedulerThreads(candidates[i]);
+			RestartScheduler();
+			double t = timeMap(&P, map, width, height);
+			if (t < bestTime)
+			{
+				bestTime = t;
+				bestThreads = candidates[i] == hardware ? 0 : candidates[i];
+			}
+		}
+		best.threads = bestThreads;
+	}
+	_aligned_free(map);
+
+	SetKernelConfig(&best);
+	if (result) *result = best;
+	return profilePath ? saveProfile(profilePath, &best) : true;
+}
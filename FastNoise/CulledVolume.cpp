@@ -0,0 +1,265 @@
+#include "headers\CulledVolume.h"
+#include "headers\TileScheduler.h"
+#include "headers\NoiseStats.h"
+#include <math.h>
+#include <float.h>
+
+//Blocks are bounded 8 at a time, a block that may cross the threshold is split into 8
+//children bounded together, down to VOLUME_LEAF. Leaves that still may cross are
+//evaluated, their samples packed into whole kernel calls like the sparse generators.
+#define VOLUME_BATCH (VECTOR_SIZE*KERNEL_UNROLL)
+
+struct VolumeContext
+{
+	float* result;
+	unsigned char* blockState;
+	const Settings* S;
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	ISIMDNoiseBound3d boundFunction;
+	int fractalType;
+	float origin[3]; //seed offset included
+	float spacing;
+	float margin; //coordinate rounding, added to every radius
+	int size[3];
+	int blocks[3];
+	float threshold;
+	int64_t* chunkEvaluated;
+};
+
+struct VolumeBatch
+{
+	uSIMD x[KERNEL_UNROLL];
+	uSIMD y[KERNEL_UNROLL];
+	uSIMD z[KERNEL_UNROLL];
+	size_t index[VOLUME_BATCH];
+	int lanes;
+	int64_t evaluated;
+};
+
+static void flushBatch(VolumeBatch* B, const VolumeContext* C)
+{
+	if (B->lanes == 0) return;
+	float* x = (float*)B->x;
+	float* y = (float*)B->y;
+	float* z = (float*)B->z;
+	for (int i = B->lanes; i < VOLUME_BATCH; i++)
+	{
+		x[i] = x[B->lanes - 1];
+		y[i] = y[B->lanes - 1];
+		z[i] = z[B->lanes - 1];
+	}
+	SIMD vx[KERNEL_UNROLL], vy[KERNEL_UNROLL], vz[KERNEL_UNROLL];
+	uSIMD r[KERNEL_UNROLL];
+	for (int u = 0; u < KERNEL_UNROLL; u++)
+	{
+		vx[u] = B->x[u].m;
+		vy[u] = B->y[u].m;
+		vz[u] = B->z[u].m;
+	}
+	C->fractalFunction(&r[0].m, vx, vy, vz, C->S, C->noiseFunction);
+	const float* values = (const float*)r;
+	for (int i = 0; i < B->lanes; i++) C->result[B->index[i]] = values[i];
+	B->evaluated += B->lanes;
+	B->lanes = 0;
+}
+
+static inline float coordinate(const VolumeContext* C, int axis, float i)
+{
+	return C->origin[axis] + i * C->spacing;
+}
+
+//Bounds of count boxes of size^3 samples starting at box[i], widened by one sample on
+//every side so a box is only proven when its neighbours are on the same side too
+static void boundBoxes(const VolumeContext* C, const int (*box)[3], int count, int size, float* lo, float* hi)
+{
+	Settings S = *C->S;
+	float half = (size - 1) * 0.5f;
+	SIMD radius = SetOne((size + 1) * 0.5f * C->spacing * 1.7320508f + C->margin);
+	for (int g = 0; g < count; g += VECTOR_SIZE)
+	{
+		for (int j = 0; j < VECTOR_SIZE; j++)
+		{
+			int i = g + j < count ? g + j : count - 1;
+			S.x.a[j] = coordinate(C, 0, box[i][0] + half);
+			S.y.a[j] = coordinate(C, 1, box[i][1] + half);
+			S.z.a[j] = coordinate(C, 2, box[i][2] + half);
+		}
+		uSIMD l, h;
+		fractalBoundSIMD3d(&l.m, &h.m, &S, radius, C->fractalType, C->boundFunction);
+		for (int j = 0; j < VECTOR_SIZE && g + j < count; j++)
+		{
+			lo[g + j] = l.a[j];
+			hi[g + j] = h.a[j];
+		}
+	}
+}
+
+//End of a box clipped to the volume, per axis
+static inline void clipBox(const VolumeContext* C, const int* box, int size, int* end)
+{
+	for (int a = 0; a < 3; a++) end[a] = box[a] + size < C->size[a] ? box[a] + size : C->size[a];
+}
+
+static void fillBox(const VolumeContext* C, const int* box, int size, float value)
+{
+	int end[3];
+	clipBox(C, box, size, end);
+	for (int z = box[2]; z < end[2]; z++)
+	{
+		for (int y = box[1]; y < end[1]; y++)
+		{
+			float* row = C->result + ((size_t)z*C->size[1] + y)*C->size[0];
+			for (int x = box[0]; x < end[0]; x++) row[x] = value;
+		}
+	}
+}
+
+static void evaluateBox(const VolumeContext* C, VolumeBatch* B, const int* box, int size)
+{
+	int end[3];
+	clipBox(C, box, size, end);
+	for (int z = box[2]; z < end[2]; z++)
+	{
+		for (int y = box[1]; y < end[1]; y++)
+		{
+			size_t row = ((size_t)z*C->size[1] + y)*C->size[0];
+			for (int x = box[0]; x < end[0]; x++)
+			{
+				int lane = B->lanes;
+				((float*)B->x)[lane] = coordinate(C, 0, (float)x);
+				((float*)B->y)[lane] = coordinate(C, 1, (float)y);
+				((float*)B->z)[lane] = coordinate(C, 2, (float)z);
+				B->index[lane] = row + x;
+				if (++B->lanes == VOLUME_BATCH) flushBatch(B, C);
+			}
+		}
+	}
+}
+
+//Returns the side of the threshold lo..hi is on, or BLOCK_CROSSING
+static inline int classify(const VolumeContext* C, float lo, float hi)
+{
+	if (lo > C->threshold) return BLOCK_ABOVE;
+	if (hi < C->threshold) return BLOCK_BELOW;
+	return BLOCK_CROSSING;
+}
+
+static void refineBox(const VolumeContext* C, VolumeBatch* B, const int* box, int size)
+{
+	if (size <= VOLUME_LEAF)
+	{
+		evaluateBox(C, B, box, size);
+		return;
+	}
+	int half = size / 2;
+	int child[8][3];
+	int count = 0;
+	for (int c = 0; c < 8; c++)
+	{
+		int x = box[0] + (c & 1) * half;
+		int y = box[1] + ((c >> 1) & 1) * half;
+		int z = box[2] + (c >> 2) * half;
+		if (x >= C->size[0] || y >= C->size[1] || z >= C->size[2]) continue;
+		child[count][0] = x;
+		child[count][1] = y;
+		child[count][2] = z;
+		count++;
+	}
+	float lo[8], hi[8];
+	boundBoxes(C, child, count, half, lo, hi);
+	for (int c = 0; c < count; c++)
+	{
+		int state = classify(C, lo[c], hi[c]);
+		if (state == BLOCK_CROSSING) refineBox(C, B, child[c], half);
+		else fillBox(C, child[c], half, state == BLOCK_ABOVE ? lo[c] : hi[c]);
+	}
+}
+
+static void volumeChunk(void* context, int begin, int end, int chunk)
+{
+	VolumeContext* C = (VolumeContext*)context;
+	VolumeBatch B;
+	B.lanes = 0;
+	B.evaluated = 0;
+	for (int b = begin; b < end; b += VECTOR_SIZE)
+	{
+		int count = end - b < VECTOR_SIZE ? end - b : VECTOR_SIZE;
+		int box[VECTOR_SIZE][3];
+		for (int i = 0; i < count; i++)
+		{
+			int block = b + i;
+			box[i][0] = block % C->blocks[0] * VOLUME_BLOCK;
+			box[i][1] = block / C->blocks[0] % C->blocks[1] * VOLUME_BLOCK;
+			box[i][2] = block / (C->blocks[0] * C->blocks[1]) * VOLUME_BLOCK;
+		}
+		float lo[VECTOR_SIZE], hi[VECTOR_SIZE];
+		boundBoxes(C, box, count, VOLUME_BLOCK, lo, hi);
+		for (int i = 0; i < count; i++)
+		{
+			int state = classify(C, lo[i], hi[i]);
+			if (C->blockState) C->blockState[b + i] = (unsigned char)state;
+			if (state == BLOCK_CROSSING) refineBox(C, &B, box[i], VOLUME_BLOCK);
+			else fillBox(C, box[i], VOLUME_BLOCK, state == BLOCK_ABOVE ? lo[i] : hi[i]);
+		}
+	}
+	flushBatch(&B, C);
+	C->chunkEvaluated[chunk] = B.evaluated;
+}
+
+bool FillVolumeCulledSIMD(float* result, unsigned char* blockState, const NoiseParams* P, float originX, float originY, float originZ, float spacing, int sizeX, int sizeY, int sizeZ, float threshold, int64_t* outEvaluated)
+{
+	FIXED_FLOAT_STATE();
+	STATS_BEGIN(setup);
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	if (!SelectFractalSIMD(P->fractalType, P->octaves, &fractalFunction)) return false;
+	if (!SelectNoiseSIMD(P->noiseType, &noiseFunction, P->quality)) return false;
+	if (sizeX < 1 || sizeY < 1 || sizeZ < 1 || !(spacing > 0)) return false;
+
+	Settings S;
+	initSIMD(&S, P->frequency, P->lacunarity, P->offset, P->gain, P->octaves);
+	VolumeContext C;
+	C.result = result;
+	C.blockState = blockState;
+	C.S = &S;
+	C.fractalFunction = fractalFunction;
+	C.noiseFunction = noiseFunction;
+	C.boundFunction = SelectNoiseBound(P->noiseType, P->quality);
+	C.fractalType = P->fractalType;
+	SeedOffset(P->seed, &C.origin[0], &C.origin[1], &C.origin[2]);
+	C.origin[0] += originX;
+	C.origin[1] += originY;
+	C.origin[2] += originZ;
+	C.spacing = spacing;
+	C.size[0] = sizeX;
+	C.size[1] = sizeY;
+	C.size[2] = sizeZ;
+	//sample and box center coordinates are each rounded a few times, by at most
+	//a few ulps of the largest coordinate
+	float largest = 0;
+	for (int a = 0; a < 3; a++)
+	{
+		C.blocks[a] = (C.size[a] + VOLUME_BLOCK - 1) / VOLUME_BLOCK;
+		largest = fmaxf(largest, fabsf(C.origin[a]) + (C.size[a] + VOLUME_BLOCK) * spacing);
+	}
+	C.margin = 8 * FLT_EPSILON * largest * 1.7320508f;
+	C.threshold = threshold;
+
+	int blockCount = C.blocks[0] * C.blocks[1] * C.blocks[2];
+	int grain = GetSchedulerGrain();
+	int chunks = ChunkCount(blockCount, grain);
+	C.chunkEvaluated = new int64_t[chunks];
+	STATS_END(setup, PHASE_SETUP);
+
+	STATS_BEGIN(kernel);
+	ParallelFor(blockCount, grain, volumeChunk, &C);
+	STATS_END(kernel, PHASE_KERNEL);
+
+	int64_t evaluated = 0;
+	for (int i = 0; i < chunks; i++) evaluated += C.chunkEvaluated[i];
+	STATS_COUNT((uint64_t)evaluated, P->fractalType == PLAIN ? 1 : P->octaves);
+	if (outEvaluated) *outEvaluated = evaluated;
+	delete[] C.chunkEvaluated;
+	return true;
+}
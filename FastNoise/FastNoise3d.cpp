@@ -1,6 +1,14 @@
 #include "headers\FastNoise3d.h"
 
 
+#ifdef USEGATHER
+#define GATHER_DEFAULT true
+#endif
+#ifndef USEGATHER
+#define GATHER_DEFAULT false
+#endif
+
+
 // For non SIMD only
 #define FADE(t) ( t * t * t * ( t * ( t * 6 - 15 ) + 10 ) )
 #define DERIVFADE(t) (t * t * ( t *(30 * t - 60 ) + 30) )
@@ -13,16 +21,71 @@ inline int fastFloor(float x) {
 	return x<xi ? xi - 1 : xi;
 }
 
-inline SIMD dotSIMD(const SIMD &x1,const SIMD &y1, const SIMD &z1,const SIMD &x2,const SIMD &y2,const SIMD &z2)
+//u and v with the sign flipped where bit 0 and bit 1 of h are set, added
+inline SIMD signedSumSIMD(const SIMDi &h, const SIMD &u, const SIMD &v)
+{
+	SIMD su = CastToFloat(ShiftLefti(Andi(h, one), 31));
+	SIMD sv = CastToFloat(ShiftLefti(Andi(h, two), 30));
+	return Add(Xor(u, su), Xor(v, sv));
+}
+
+//Dot product of x,y,z with gradient h (0-11) of the gradX/gradY/gradZ tables:
+//h < 4 is (+-1,+-1,0), h < 8 is (+-1,0,+-1), the rest (0,+-1,+-1)
+inline SIMD gradDotSIMD3d(const SIMDi &h, const SIMD &x, const SIMD &y, const SIMD &z)
+{
+	SIMD lt8 = CastToFloat(LessThani(h, eight));
+	SIMD lt4 = CastToFloat(LessThani(h, four));
+	SIMD u = Or(And(lt8, x), AndNot(lt8, y));
+	SIMD v = Or(And(lt4, y), AndNot(lt4, z));
+	return signedSumSIMD(h, u, v);
+}
+
+//Low 32 bits of a*b in every lane
+inline SIMDi mulLowSIMD(const SIMDi &a, int32_t b)
 {
-	SIMD xx = Mul(x1, x2);
-	SIMD yy = Mul(y1, y2);
-	SIMD zz = Mul(z1, z2);
-	return Add(xx, Add(yy, zz));
+#ifdef SSE41
+	return MulLowi(a, SetOnei(b));
+#endif
+#ifndef SSE41
+	uSIMDi u;
+	u.m = a;
+	for (int i = 0; i < VECTOR_SIZE; i++) u.a[i] = (int)((uint32_t)u.a[i] * (uint32_t)b);
+	return u.m;
+#endif
 }
 
+//Lattice hash of QUALITY_FASTEST: the lattice coordinates times a prime per axis (hx, hy,
+//hz), combined and mixed by one multiply instead of three dependent perm lookups. The
+//top 16 bits are scaled to a gradient 0..11, so all 12 directions are equally likely.
+#define HASH_PRIME_X 0x6c8e9cf5
+#define HASH_PRIME_Y 0x2c1b3c6d
+#define HASH_PRIME_Z 0x297a2d39
+#define HASH_MIX 0x7feb352d
 
-inline SIMD simplexSIMD3d(SIMD* x, SIMD* y, SIMD* z) {
+inline SIMDi mixHashSIMD(const SIMDi &h)
+{
+	SIMDi m = ShiftRighti(mulLowSIMD(h, HASH_MIX), 16);
+	//m * 12 >> 16 as m * 3 >> 14
+	return ShiftRighti(Addi(m, ShiftLefti(m, 1)), 14);
+}
+
+inline SIMDi hashCornerSIMD(const SIMDi &hx, const SIMDi &hy, const SIMDi &hz)
+{
+	return mixHashSIMD(Xori(hx, Xori(hy, hz)));
+}
+
+//QUALITY_FAST keeps the first two perm rounds of the reference, over z then y, and mixes
+//in x arithmetically instead of the third dependent round: 6 lookups for a Perlin cell
+//instead of 14 and for a simplex instead of 12. The perm value is spread by a prime like
+//the axes of QUALITY_FASTEST, a value 0..255 in the low bits would hardly move the top
+//bits that pick the gradient.
+inline SIMDi hashPermSIMD(const SIMDi &hx, const SIMDi &pzy)
+{
+	return mixHashSIMD(Xori(hx, mulLowSIMD(pzy, HASH_PRIME_Y)));
+}
+
+template<bool GATHER, int QUALITY>
+inline SIMD simplexSIMD3dT(SIMD* x, SIMD* y, SIMD* z) {
 	uSIMDi i, j, k;
 
 	uSIMD s;
@@ -67,26 +130,18 @@ inline SIMD simplexSIMD3d(SIMD* x, SIMD* y, SIMD* z) {
 	y>z>x   -> 010  011
 	y>x>=z  -> 010  110
 	*/
+	//All six orders follow from three comparisons:
+	//i1 = x>=y & x>=z, j1 = y>x & y>=z, k1 = z>x & z>y, i2 = x>=y | x>=z, j2 = y>x | y>=z, k2 = z>x | z>y
+	SIMD xy = GreaterThanOrEq(x0, y0);
+	SIMD xz = GreaterThanOrEq(x0, z0);
+	SIMD yz = GreaterThanOrEq(y0, z0);
 	uSIMDi i1, i2, j1, j2, k1, k2;
-	i1.m = Andi(one, Andi(CastToInt(GreaterThanOrEq(x0, y0)), CastToInt(GreaterThanOrEq(x0, z0))));
-	j1.m = Andi(one, Andi(CastToInt(GreaterThan(y0, x0)), CastToInt(GreaterThan(y0, z0))));
-	k1.m = Andi(one, Andi(CastToInt(GreaterThan(z0, x0)), CastToInt(GreaterThan(z0, y0))));
-
-	//for i2
-	SIMDi yx_xz = Andi(CastToInt(GreaterThanOrEq(x0, y0)), CastToInt(LessThan(x0, z0)));
-	SIMDi zx_xy = Andi(CastToInt(GreaterThanOrEq(x0, z0)), CastToInt(LessThan(x0, y0)));
-
-	//for j2
-	SIMDi xy_yz = Andi(CastToInt(LessThan(x0, y0)), CastToInt(LessThan(y0, z0)));
-	SIMDi zy_yx = Andi(CastToInt(GreaterThanOrEq(y0, z0)), CastToInt(GreaterThanOrEq(x0, y0)));
-
-	//for k2
-	SIMDi yz_zx = Andi(CastToInt(LessThan(y0, z0)), CastToInt(GreaterThanOrEq(x0, z0)));
-	SIMDi xz_zy = Andi(CastToInt(LessThan(x0, z0)), CastToInt(GreaterThanOrEq(y0, z0)));
-
-	i2.m = Andi(one, Ori(i1.m, Ori(yx_xz, zx_xy)));
-	j2.m = Andi(one, Ori(j1.m, Ori(xy_yz, zy_yx)));
-	k2.m = Andi(one, Ori(k1.m, Ori(yz_zx, xz_zy)));
+	i1.m = Andi(one, CastToInt(And(xy, xz)));
+	j1.m = Andi(one, CastToInt(AndNot(xy, yz)));
+	k1.m = Andi(one, Equali(CastToInt(Or(xz, yz)), zeroi));
+	i2.m = Andi(one, CastToInt(Or(xy, xz)));
+	j2.m = Andi(one, Equali(CastToInt(AndNot(yz, xy)), zeroi));
+	k2.m = Andi(one, Equali(CastToInt(And(xz, yz)), zeroi));
 
 	// A step of (1,0,0) in (i,j,k) means a step of (1-c,-c,-c) in (x,y,z),
 	// a step of (0,1,0) in (i,j,k) means a step of (-c,1-c,-c) in (x,y,z), and
@@ -110,39 +165,118 @@ inline SIMD simplexSIMD3d(SIMD* x, SIMD* y, SIMD* z) {
 	uSIMDi kk;
 	kk.m = Andi(k.m, ff);
 	uSIMDi gi0, gi1, gi2, gi3;
-#ifndef USEGATHER
-	for (int i = 0; i < VECTOR_SIZE; i++)
+	if (QUALITY == QUALITY_FAST)
 	{
-		gi0.a[i] = permMOD12[ii.a[i] + perm[jj.a[i] + perm[kk.a[i]]]];
-		gi1.a[i] = permMOD12[ii.a[i] + i1.a[i] + perm[jj.a[i] + j1.a[i] + perm[kk.a[i]+k1.a[i]]]];
-		gi2.a[i] = permMOD12[ii.a[i] + i2.a[i] + perm[jj.a[i] + j2.a[i] + perm[kk.a[i]+k2.a[i]]]];
-		gi3.a[i] = permMOD12[ii.a[i] + 1 + perm[jj.a[i] + 1 + perm[kk.a[i]]]];
-	}
+		//the corners are at kk or kk+1 on z, so the first round is only 2 lookups
+		uSIMDi pz0, pz1, pkj0, pkj1, pkj2, pkj3;
+#ifdef USEGATHER
+		if (GATHER)
+		{
+			pz0.m = Gather(perm, kk.m, 4);
+			pz1.m = Gather(perm, Addi(kk.m, one), 4);
+		}
+		else
+#endif
+		{
+			for (int i = 0; i < VECTOR_SIZE; i++)
+			{
+				pz0.a[i] = perm[kk.a[i]];
+				pz1.a[i] = perm[kk.a[i] + 1];
+			}
+		}
+		SIMDi dz = Xori(pz0.m, pz1.m);
+		SIMDi pzk1 = Xori(pz0.m, Andi(Subi(zeroi, k1.m), dz));
+		SIMDi pzk2 = Xori(pz0.m, Andi(Subi(zeroi, k2.m), dz));
+#ifdef USEGATHER
+		if (GATHER)
+		{
+			pkj0.m = Gather(perm, Addi(jj.m, pz0.m), 4);
+			pkj1.m = Gather(perm, Addi(Addi(jj.m, j1.m), pzk1), 4);
+			pkj2.m = Gather(perm, Addi(Addi(jj.m, j2.m), pzk2), 4);
+			pkj3.m = Gather(perm, Addi(Addi(jj.m, one), pz1.m), 4);
+		}
+		else
 #endif
+		{
+			uSIMDi z1, z2;
+			z1.m = pzk1;
+			z2.m = pzk2;
+			for (int i = 0; i < VECTOR_SIZE; i++)
+			{
+				pkj0.a[i] = perm[jj.a[i] + pz0.a[i]];
+				pkj1.a[i] = perm[jj.a[i] + j1.a[i] + z1.a[i]];
+				pkj2.a[i] = perm[jj.a[i] + j2.a[i] + z2.a[i]];
+				pkj3.a[i] = perm[jj.a[i] + 1 + pz1.a[i]];
+			}
+		}
+		SIMDi hx0 = mulLowSIMD(ii.m, HASH_PRIME_X);
+		SIMDi hx1 = mulLowSIMD(Andi(Addi(ii.m, one), ff), HASH_PRIME_X);
+		SIMDi dx = Xori(hx0, hx1);
+		gi0.m = hashPermSIMD(hx0, pkj0.m);
+		gi1.m = hashPermSIMD(Xori(hx0, Andi(Subi(zeroi, i1.m), dx)), pkj1.m);
+		gi2.m = hashPermSIMD(Xori(hx0, Andi(Subi(zeroi, i2.m), dx)), pkj2.m);
+		gi3.m = hashPermSIMD(hx1, pkj3.m);
+	}
+	else if (QUALITY == QUALITY_FASTEST)
+	{
+		//a corner is at +0 or +1 on each axis, both hashed once and picked with the 0/1 offsets
+		SIMDi hx0 = mulLowSIMD(ii.m, HASH_PRIME_X);
+		SIMDi hy0 = mulLowSIMD(jj.m, HASH_PRIME_Y);
+		SIMDi hz0 = mulLowSIMD(kk.m, HASH_PRIME_Z);
+		SIMDi dx = Xori(hx0, mulLowSIMD(Andi(Addi(ii.m, one), ff), HASH_PRIME_X));
+		SIMDi dy = Xori(hy0, mulLowSIMD(Andi(Addi(jj.m, one), ff), HASH_PRIME_Y));
+		SIMDi dz = Xori(hz0, mulLowSIMD(Andi(Addi(kk.m, one), ff), HASH_PRIME_Z));
+		gi0.m = hashCornerSIMD(hx0, hy0, hz0);
+		gi1.m = hashCornerSIMD(Xori(hx0, Andi(Subi(zeroi, i1.m), dx)), Xori(hy0, Andi(Subi(zeroi, j1.m), dy)), Xori(hz0, Andi(Subi(zeroi, k1.m), dz)));
+		gi2.m = hashCornerSIMD(Xori(hx0, Andi(Subi(zeroi, i2.m), dx)), Xori(hy0, Andi(Subi(zeroi, j2.m), dy)), Xori(hz0, Andi(Subi(zeroi, k2.m), dz)));
+		gi3.m = hashCornerSIMD(Xori(hx0, dx), Xori(hy0, dy), Xori(hz0, dz));
+	}
+	else
 #ifdef USEGATHER
-	SIMDi pkk = Gather(perm, kk.m, 4);	
-	SIMDi pkkk1 = Gather(perm, Addi(kk.m, k1.m), 4);
-	SIMDi pkkk2 = Gather(perm, Addi(kk.m, k2.m), 4);
-	SIMDi pkk1 = Gather(perm, Addi(kk.m, one), 4);
+	if (GATHER)
+	{
+		SIMDi pkk = Gather(perm, kk.m, 4);	
+		SIMDi pkkk1 = Gather(perm, Addi(kk.m, k1.m), 4);
+		SIMDi pkkk2 = Gather(perm, Addi(kk.m, k2.m), 4);
+		SIMDi pkk1 = Gather(perm, Addi(kk.m, one), 4);
 
-	SIMDi pjj = Gather(perm, Addi(jj.m, pkk), 4);
-	SIMDi pjjj1 = Gather(perm, Addi(jj.m, Addi(j1.m, pkkk1)), 4);
-	SIMDi pjjj2 = Gather(perm, Addi(jj.m, Addi(j2.m, pkkk2)), 4);
-	SIMDi pjj1 = Gather(perm, Addi(jj.m, Addi(one, pkk1)), 4);
+		SIMDi pjj = Gather(perm, Addi(jj.m, pkk), 4);
+		SIMDi pjjj1 = Gather(perm, Addi(jj.m, Addi(j1.m, pkkk1)), 4);
+		SIMDi pjjj2 = Gather(perm, Addi(jj.m, Addi(j2.m, pkkk2)), 4);
+		SIMDi pjj1 = Gather(perm, Addi(jj.m, Addi(one, pkk1)), 4);
 
 
-	gi0.m = Gather(permMOD12, Addi(ii.m, pjj), 4);
-	gi1.m = Gather(permMOD12, Addi(i1.m,Addi(ii.m, pjjj1)), 4);
-	gi2.m = Gather(permMOD12, Addi(i2.m,Addi(ii.m, pjjj2)), 4);
-	gi3.m = Gather(permMOD12, Addi(one,Addi(ii.m, pjj1)), 4);
+		gi0.m = Gather(permMOD12, Addi(ii.m, pjj), 4);
+		gi1.m = Gather(permMOD12, Addi(i1.m,Addi(ii.m, pjjj1)), 4);
+		gi2.m = Gather(permMOD12, Addi(i2.m,Addi(ii.m, pjjj2)), 4);
+		gi3.m = Gather(permMOD12, Addi(one,Addi(ii.m, pjj1)), 4);
+	}
+	else
 #endif
+	{
+		for (int i = 0; i < VECTOR_SIZE; i++)
+		{
+			gi0.a[i] = permMOD12[ii.a[i] + perm[jj.a[i] + perm[kk.a[i]]]];
+			gi1.a[i] = permMOD12[ii.a[i] + i1.a[i] + perm[jj.a[i] + j1.a[i] + perm[kk.a[i]+k1.a[i]]]];
+			gi2.a[i] = permMOD12[ii.a[i] + i2.a[i] + perm[jj.a[i] + j2.a[i] + perm[kk.a[i]+k2.a[i]]]];
+			gi3.a[i] = permMOD12[ii.a[i] + 1 + perm[jj.a[i] + 1 + perm[kk.a[i] + 1]]];
+		}
+	}
 
 	//ti = .6 - xi*xi - yi*yi - zi*zi
-	
 	SIMD t0 = Sub(Sub(Sub(psix, Mul(x0, x0)), Mul(y0, y0)), Mul(z0, z0));
 	SIMD t1 = Sub(Sub(Sub(psix, Mul(x1, x1)), Mul(y1, y1)), Mul(z1, z1));
 	SIMD t2 = Sub(Sub(Sub(psix, Mul(x2, x2)), Mul(y2, y2)), Mul(z2, z2));
 	SIMD t3 = Sub(Sub(Sub(psix, Mul(x3, x3)), Mul(y3, y3)), Mul(z3, z3));
+	//the cheaper tiers cull corners by clamping ti to 0 instead of masking their
+	//contributions below, which rounds a little differently
+	if (QUALITY != QUALITY_REFERENCE)
+	{
+		t0 = Max(t0, zero);
+		t1 = Max(t1, zero);
+		t2 = Max(t2, zero);
+		t3 = Max(t3, zero);
+	}
 
 	//ti*ti*ti*ti
 	SIMD t0q = Mul(t0, t0);
@@ -154,73 +288,34 @@ inline SIMD simplexSIMD3d(SIMD* x, SIMD* y, SIMD* z) {
 	SIMD t3q = Mul(t3, t3);
 	t3q = Mul(t3q, t3q);
 
+	//gradients are picked arithmetically instead of looked up in gradX/gradY/gradZ,
+	SIMD n0 = Mul(t0q, gradDotSIMD3d(gi0.m, x0, y0, z0));
+	SIMD n1 = Mul(t1q, gradDotSIMD3d(gi1.m, x1, y1, z1));
+	SIMD n2 = Mul(t2q, gradDotSIMD3d(gi2.m, x2, y2, z2));
+	SIMD n3 = Mul(t3q, gradDotSIMD3d(gi3.m, x3, y3, z3));
 
-	uSIMD
-		gi0x, gi0y, gi0z,
-		gi1x, gi1y, gi1z,
-		gi2x, gi2y, gi2z,
-		gi3x, gi3y, gi3z;
-#ifndef USEGATHER
-	for (int i = 0; i < VECTOR_SIZE; i++)
+	//if ti < 0 then 0 else ni
+	if (QUALITY == QUALITY_REFERENCE)
 	{
-		gi0x.a[i] = gradX[gi0.a[i]];
-		gi0y.a[i] = gradY[gi0.a[i]];
-		gi0z.a[i] = gradZ[gi0.a[i]];
-
-		gi1x.a[i] = gradX[gi1.a[i]];
-		gi1y.a[i] = gradY[gi1.a[i]];
-		gi1z.a[i] = gradZ[gi1.a[i]];
-		
-		gi2x.a[i] = gradX[gi2.a[i]];
-		gi2y.a[i] = gradY[gi2.a[i]];
-		gi2z.a[i] = gradZ[gi2.a[i]];
-
-		gi3x.a[i] = gradX[gi3.a[i]];
-		gi3y.a[i] = gradY[gi3.a[i]];
-		gi3z.a[i] = gradZ[gi3.a[i]];
-
+		SIMD cond;
+		cond = LessThan(t0, zero);
+		n0 = Or(And(cond, zero), AndNot(cond, n0));
+		cond = LessThan(t1, zero);
+		n1 = Or(And(cond, zero), AndNot(cond, n1));
+		cond = LessThan(t2, zero);
+		n2 = Or(And(cond, zero), AndNot(cond, n2));
+		cond = LessThan(t3, zero);
+		n3 = Or(And(cond, zero), AndNot(cond, n3));
 	}
-#endif
-#ifdef USEGATHER
-	gi0x.m = Gatherf(gradX, gi0.m, 4);
-	gi0y.m = Gatherf(gradY, gi0.m, 4);
-	gi0z.m = Gatherf(gradZ, gi0.m, 4);
-
-	gi1x.m = Gatherf(gradX, gi1.m, 4);
-	gi1y.m = Gatherf(gradY, gi1.m, 4);
-	gi1z.m = Gatherf(gradZ, gi1.m, 4);
-
-	gi2x.m = Gatherf(gradX, gi2.m, 4);
-	gi2y.m = Gatherf(gradY, gi2.m, 4);
-	gi2z.m = Gatherf(gradZ, gi2.m, 4);
-	
-	gi3x.m = Gatherf(gradX, gi3.m, 4);
-	gi3y.m = Gatherf(gradY, gi3.m, 4);
-	gi3z.m = Gatherf(gradZ, gi3.m, 4);
-#endif
-
-	SIMD n0 = Mul(t0q, dotSIMD(gi0x.m, gi0y.m, gi0z.m, x0, y0, z0));
-	SIMD n1 = Mul(t1q, dotSIMD(gi1x.m, gi1y.m, gi1z.m, x1, y1, z1));
-	SIMD n2 = Mul(t2q, dotSIMD(gi2x.m, gi2y.m, gi2z.m, x2, y2, z2));
-	SIMD n3 = Mul(t3q, dotSIMD(gi3x.m, gi3y.m, gi3z.m, x3, y3, z3));
-
-
-
-	//if ti < 0 then 0 else ni
-	SIMD cond;
-	cond = LessThan(t0, zero);
-	n0 = Or(And(cond, zero), AndNot(cond, n0));
-	cond = LessThan(t1, zero);
-	n1 = Or(And(cond, zero), AndNot(cond, n1));
-	cond = LessThan(t2, zero);
-	n2 = Or(And(cond, zero), AndNot(cond, n2));
-	cond = LessThan(t3, zero);
-	n3 = Or(And(cond, zero), AndNot(cond, n3));
-
 
 	return  Mul(thirtytwo, Add(n0, Add(n1, Add(n2, n3))));
 }
 
+inline SIMD simplexSIMD3d(SIMD* x, SIMD* y, SIMD* z)
+{
+	return simplexSIMD3dT<GATHER_DEFAULT, QUALITY_REFERENCE>(x, y, z);
+}
+
 inline float dot(float x1, float y1, float z1, float x2, float y2, float z2)
 {
 	return x1*x2 + y1*y2 + z1*z2;
@@ -355,9 +450,6 @@ inline float grad3d(int hash, float x, float y, float z) {
 inline SIMD gradSIMD3d(SIMDi * __restrict hash, SIMD * __restrict x, SIMD * __restrict y, SIMD * __restrict z) {
 
 	SIMDi h = Andi(*hash, fifteeni);
-	SIMD h1 = ConvertToFloat(Equali(zeroi, Andi(h, one)));
-	SIMD h2 = ConvertToFloat(Equali(zeroi, Andi(h, two)));
-
 
 	//if h < 8 then x, else y
 	SIMD u = CastToFloat(LessThani(h, eight));
@@ -365,19 +457,98 @@ inline SIMD gradSIMD3d(SIMDi * __restrict hash, SIMD * __restrict x, SIMD * __re
 
 	//if h < 4 then y else if h is 12 or 14 then x else z
 	SIMD v = CastToFloat(LessThani(h, four));
-	SIMD h12o14 = CastToFloat(Equali(zeroi, Ori(Equali(h, twelve), Equali(h, fourteen))));
-	h12o14 = Or(AndNot(h12o14, *x), And(h12o14, *z));
+	//h | 2 is 14 only for 12 and 14
+	SIMD h12o14 = CastToFloat(Equali(Ori(h, two), fourteen));
+	h12o14 = Or(And(h12o14, *x), AndNot(h12o14, *z));
 	v = Or(And(v, *y), AndNot(v, h12o14));
 
+	//-u if bit 0 of h is set, -v if bit 1 is, then add them
+	return signedSumSIMD(h, u, v);
+}
+
+//Gradient of the Perlin kernels. The perm hashes of the reference keep the repeated
+//directions of 12..15, the hashes of the cheaper tiers are already 0..11.
+template<int QUALITY>
+inline SIMD perlinGradSIMD3d(SIMDi h, SIMD x, SIMD y, SIMD z)
+{
+	if (QUALITY != QUALITY_REFERENCE) return gradDotSIMD3d(h, x, y, z);
+	return gradSIMD3d(&h, &x, &y, &z);
+}
 
-	//if h1 then -u else u	
-	//if h2 then -v else v
-	//then add them
-	return Add(Or(AndNot(h1, Sub(zero, u)), And(h1, u)), Or(AndNot(h2, Sub(zero, v)), And(h2, v)));
+
+//6t^5 - 15t^4 + 10t^3, or 3t^2 - 2t^3 for the cheaper tiers. The cubic is only C1, so
+//second derivatives (slopes of normals, curvature) show the lattice.
+template<int QUALITY>
+inline SIMD fadeSIMD3d(const SIMD &t)
+{
+	if (QUALITY != QUALITY_REFERENCE) return Mul(Mul(t, t), Sub(SetOne(3.0f), Add(t, t)));
+	return Mul(Mul(Mul(Add(Mul(Sub(Mul(t, six), fifteen), t), ten), t), t), t);
 }
 
+//QUALITY_FASTEST hashes of the 8 cell corners, in the order of the perm lookups
+inline void perlinHashSIMD3d(SIMDi* p, const SIMDi &ix0, const SIMDi &ix1, const SIMDi &iy0, const SIMDi &iy1, const SIMDi &iz0, const SIMDi &iz1)
+{
+	SIMDi hx0 = mulLowSIMD(ix0, HASH_PRIME_X);
+	SIMDi hx1 = mulLowSIMD(ix1, HASH_PRIME_X);
+	SIMDi hy0 = mulLowSIMD(iy0, HASH_PRIME_Y);
+	SIMDi hy1 = mulLowSIMD(iy1, HASH_PRIME_Y);
+	SIMDi hz0 = mulLowSIMD(iz0, HASH_PRIME_Z);
+	SIMDi hz1 = mulLowSIMD(iz1, HASH_PRIME_Z);
+	p[0] = hashCornerSIMD(hx0, hy0, hz0);
+	p[1] = hashCornerSIMD(hx0, hy0, hz1);
+	p[2] = hashCornerSIMD(hx0, hy1, hz0);
+	p[3] = hashCornerSIMD(hx0, hy1, hz1);
+	p[4] = hashCornerSIMD(hx1, hy0, hz0);
+	p[5] = hashCornerSIMD(hx1, hy0, hz1);
+	p[6] = hashCornerSIMD(hx1, hy1, hz0);
+	p[7] = hashCornerSIMD(hx1, hy1, hz1);
+}
 
-inline SIMD perlinSIMD3d(SIMD* __restrict x, SIMD* __restrict y, SIMD* __restrict z)
+//QUALITY_FAST hashes of the 8 cell corners from the perm[y + perm[z]] of the 4 y,z
+//edges, in the order y0z0, y0z1, y1z0, y1z1
+template<bool GATHER>
+inline void perlinPermHashSIMD3d(SIMDi* p, const SIMDi &ix0, const SIMDi &ix1, const SIMDi &iy0, const SIMDi &iy1, const SIMDi &iz0, const SIMDi &iz1)
+{
+	uSIMDi pzy[4];
+#ifdef USEGATHER
+	if (GATHER)
+	{
+		SIMDi pz0 = Gather(perm, iz0, 4);
+		SIMDi pz1 = Gather(perm, iz1, 4);
+		pzy[0].m = Gather(perm, Addi(iy0, pz0), 4);
+		pzy[1].m = Gather(perm, Addi(iy0, pz1), 4);
+		pzy[2].m = Gather(perm, Addi(iy1, pz0), 4);
+		pzy[3].m = Gather(perm, Addi(iy1, pz1), 4);
+	}
+	else
+#endif
+	{
+		uSIMDi uy0, uy1, uz0, uz1;
+		uy0.m = iy0;
+		uy1.m = iy1;
+		uz0.m = iz0;
+		uz1.m = iz1;
+		for (int i = 0; i < VECTOR_SIZE; i++)
+		{
+			int pz0 = perm[uz0.a[i]];
+			int pz1 = perm[uz1.a[i]];
+			pzy[0].a[i] = perm[uy0.a[i] + pz0];
+			pzy[1].a[i] = perm[uy0.a[i] + pz1];
+			pzy[2].a[i] = perm[uy1.a[i] + pz0];
+			pzy[3].a[i] = perm[uy1.a[i] + pz1];
+		}
+	}
+	SIMDi hx0 = mulLowSIMD(ix0, HASH_PRIME_X);
+	SIMDi hx1 = mulLowSIMD(ix1, HASH_PRIME_X);
+	for (int k = 0; k < 4; k++)
+	{
+		p[k] = hashPermSIMD(hx0, pzy[k].m);
+		p[k + 4] = hashPermSIMD(hx1, pzy[k].m);
+	}
+}
+
+template<bool GATHER, int QUALITY>
+inline SIMD perlinSIMD3dT(SIMD* __restrict x, SIMD* __restrict y, SIMD* __restrict z)
 {
 	uSIMDi ix0, iy0, ix1, iy1, iz0, iz1;
 	SIMD fx0, fy0, fz0, fx1, fy1, fz1;
@@ -418,106 +589,93 @@ inline SIMD perlinSIMD3d(SIMD* __restrict x, SIMD* __restrict y, SIMD* __restric
 	iz0.m = Andi(iz0.m, ff);
 
 
-	SIMD
-		r = Mul(fz0, six);
-	r = Sub(r, fifteen);
-	r = Mul(r, fz0);
-	r = Add(r, ten);
-	r = Mul(r, fz0);
-	r = Mul(r, fz0);
-	r = Mul(r, fz0);
-
-	SIMD
-		t = Mul(fy0, six);
-	t = Sub(t, fifteen);
-	t = Mul(t, fy0);
-	t = Add(t, ten);
-	t = Mul(t, fy0);
-	t = Mul(t, fy0);
-	t = Mul(t, fy0);
-
-	SIMD
-		s = Mul(fx0, six);
-	s = Sub(s, fifteen);
-	s = Mul(s, fx0);
-	s = Add(s, ten);
-	s = Mul(s, fx0);
-	s = Mul(s, fx0);
-	s = Mul(s, fx0);
+	SIMD r = fadeSIMD3d<QUALITY>(fz0);
+	SIMD t = fadeSIMD3d<QUALITY>(fy0);
+	SIMD s = fadeSIMD3d<QUALITY>(fx0);
 
 
 	uSIMDi p[8];
-#ifndef USEGATHER
-
-	
-	for (int i = 0; i < VECTOR_SIZE; i++)
+	if (QUALITY != QUALITY_REFERENCE)
 	{
-		p[0].a[i] = perm[ix0.a[i] + perm[iy0.a[i] + perm[iz0.a[i]]]];
-		p[1].a[i] = perm[ix0.a[i] + perm[iy0.a[i] + perm[iz1.a[i]]]];
-		p[2].a[i] = perm[ix0.a[i] + perm[iy1.a[i] + perm[iz0.a[i]]]];
-		p[3].a[i] = perm[ix0.a[i] + perm[iy1.a[i] + perm[iz1.a[i]]]];
-		p[4].a[i] = perm[ix1.a[i] + perm[iy0.a[i] + perm[iz0.a[i]]]];
-		p[5].a[i] = perm[ix1.a[i] + perm[iy0.a[i] + perm[iz1.a[i]]]];
-		p[6].a[i] = perm[ix1.a[i] + perm[iy1.a[i] + perm[iz0.a[i]]]];
-		p[7].a[i] = perm[ix1.a[i] + perm[iy1.a[i] + perm[iz1.a[i]]]];
-
+		SIMDi h[8];
+		if (QUALITY == QUALITY_FAST) perlinPermHashSIMD3d<GATHER>(h, ix0.m, ix1.m, iy0.m, iy1.m, iz0.m, iz1.m);
+		else perlinHashSIMD3d(h, ix0.m, ix1.m, iy0.m, iy1.m, iz0.m, iz1.m);
+		for (int k = 0; k < 8; k++) p[k].m = h[k];
 	}
-#endif // !AVX
-#ifdef USEGATHER 
-	SIMDi pz0, pz1, pz0y0, pz0y1, pz1y1, pz1y0;
-
-	pz0 = Gather(perm, iz0.m, 4);
-	pz1 = Gather(perm, iz1.m, 4);
+	else
+#ifdef USEGATHER
+	if (GATHER)
+	{
+		SIMDi pz0, pz1, pz0y0, pz0y1, pz1y1, pz1y0;
 
-	pz0y0 = Gather(perm, Addi(iy0.m, pz0), 4);
-	pz0y1 = Gather(perm, Addi(iy1.m, pz0), 4);
-	pz1y0 = Gather(perm, Addi(iy0.m, pz1), 4);
-	pz1y1 = Gather(perm, Addi(iy1.m, pz1), 4);
+		pz0 = Gather(perm, iz0.m, 4);
+		pz1 = Gather(perm, iz1.m, 4);
 
-	p[0].m = Addi(ix0.m, pz0y0);
-	p[0].m = Gather(perm, p[0].m, 4);
+		pz0y0 = Gather(perm, Addi(iy0.m, pz0), 4);
+		pz0y1 = Gather(perm, Addi(iy1.m, pz0), 4);
+		pz1y0 = Gather(perm, Addi(iy0.m, pz1), 4);
+		pz1y1 = Gather(perm, Addi(iy1.m, pz1), 4);
 
-	p[1].m = Addi(ix0.m, pz1y0);
-	p[1].m = Gather(perm, p[1].m, 4);
+		p[0].m = Addi(ix0.m, pz0y0);
+		p[0].m = Gather(perm, p[0].m, 4);
 
-	p[2].m = Addi(ix0.m, pz0y1);
-	p[2].m = Gather(perm, p[2].m, 4);
+		p[1].m = Addi(ix0.m, pz1y0);
+		p[1].m = Gather(perm, p[1].m, 4);
 
-	p[3].m = Addi(ix0.m, pz1y1);
-	p[3].m = Gather(perm, p[3].m, 4);
+		p[2].m = Addi(ix0.m, pz0y1);
+		p[2].m = Gather(perm, p[2].m, 4);
 
-	p[4].m = Addi(ix1.m, pz0y0);
-	p[4].m = Gather(perm, p[4].m, 4);
+		p[3].m = Addi(ix0.m, pz1y1);
+		p[3].m = Gather(perm, p[3].m, 4);
 
-	p[5].m = Addi(ix1.m, pz1y0);
-	p[5].m = Gather(perm, p[5].m, 4);
+		p[4].m = Addi(ix1.m, pz0y0);
+		p[4].m = Gather(perm, p[4].m, 4);
 
-	p[6].m = Addi(ix1.m, pz0y1);
-	p[6].m = Gather(perm, p[6].m, 4);
+		p[5].m = Addi(ix1.m, pz1y0);
+		p[5].m = Gather(perm, p[5].m, 4);
 
-	p[7].m = Addi(ix1.m, pz1y1);
-	p[7].m = Gather(perm, p[7].m, 4);
+		p[6].m = Addi(ix1.m, pz0y1);
+		p[6].m = Gather(perm, p[6].m, 4);
 
+		p[7].m = Addi(ix1.m, pz1y1);
+		p[7].m = Gather(perm, p[7].m, 4);
+	}
+	else
+#endif
+	{
 
-#endif // AVX
+	
+		for (int i = 0; i < VECTOR_SIZE; i++)
+		{
+			p[0].a[i] = perm[ix0.a[i] + perm[iy0.a[i] + perm[iz0.a[i]]]];
+			p[1].a[i] = perm[ix0.a[i] + perm[iy0.a[i] + perm[iz1.a[i]]]];
+			p[2].a[i] = perm[ix0.a[i] + perm[iy1.a[i] + perm[iz0.a[i]]]];
+			p[3].a[i] = perm[ix0.a[i] + perm[iy1.a[i] + perm[iz1.a[i]]]];
+			p[4].a[i] = perm[ix1.a[i] + perm[iy0.a[i] + perm[iz0.a[i]]]];
+			p[5].a[i] = perm[ix1.a[i] + perm[iy0.a[i] + perm[iz1.a[i]]]];
+			p[6].a[i] = perm[ix1.a[i] + perm[iy1.a[i] + perm[iz0.a[i]]]];
+			p[7].a[i] = perm[ix1.a[i] + perm[iy1.a[i] + perm[iz1.a[i]]]];
+
+		}
+	}
 
 
-	SIMD nxy0 = gradSIMD3d(&p[0].m, &fx0, &fy0, &fz0);
-	SIMD nxy1 = gradSIMD3d(&p[1].m, &fx0, &fy0, &fz1);
+	SIMD nxy0 = perlinGradSIMD3d<QUALITY>(p[0].m, fx0, fy0, fz0);
+	SIMD nxy1 = perlinGradSIMD3d<QUALITY>(p[1].m, fx0, fy0, fz1);
 	SIMD nx0 = Add(nxy0, Mul(r, Sub(nxy1, nxy0)));
 
-	nxy0 = gradSIMD3d(&p[2].m, &fx0, &fy1, &fz0);
-	nxy1 = gradSIMD3d(&p[3].m, &fx0, &fy1, &fz1);
+	nxy0 = perlinGradSIMD3d<QUALITY>(p[2].m, fx0, fy1, fz0);
+	nxy1 = perlinGradSIMD3d<QUALITY>(p[3].m, fx0, fy1, fz1);
 	SIMD nx1 = Add(nxy0, Mul(r, Sub(nxy1, nxy0)));
 
 	SIMD n0 = Add(nx0, Mul(t, Sub(nx1, nx0)));
 
-	nxy0 = gradSIMD3d(&p[4].m, &fx1, &fy0, &fz0);
-	nxy1 = gradSIMD3d(&p[5].m, &fx1, &fy0, &fz1);
+	nxy0 = perlinGradSIMD3d<QUALITY>(p[4].m, fx1, fy0, fz0);
+	nxy1 = perlinGradSIMD3d<QUALITY>(p[5].m, fx1, fy0, fz1);
 	nx0 = Add(nxy0, Mul(r, Sub(nxy1, nxy0)));
 
-	nxy0 = gradSIMD3d(&p[6].m, &fx1, &fy1, &fz0);
-	nxy1 = gradSIMD3d(&p[7].m, &fx1, &fy1, &fz1);
+	nxy0 = perlinGradSIMD3d<QUALITY>(p[6].m, fx1, fy1, fz0);
+	nxy1 = perlinGradSIMD3d<QUALITY>(p[7].m, fx1, fy1, fz1);
 	nx1 = Add(nxy0, Mul(r, Sub(nxy1, nxy0)));
 
 	SIMD n1 = Add(nx0, Mul(t, Sub(nx1, nx0)));
@@ -526,6 +684,451 @@ inline SIMD perlinSIMD3d(SIMD* __restrict x, SIMD* __restrict y, SIMD* __restric
 
 }
 
+inline SIMD perlinSIMD3d(SIMD* __restrict x, SIMD* __restrict y, SIMD* __restrict z)
+{
+	return perlinSIMD3dT<GATHER_DEFAULT, QUALITY_REFERENCE>(x, y, z);
+}
+
+
+//U independent vectors at once. Every step is done for all of
+//them before the next one, so their gather chains and fade polynomials overlap
+//instead of each vector waiting on its own perm lookups
+template<int U, bool GATHER, int QUALITY>
+inline void perlinGroupSIMD3d(SIMD* __restrict out, const SIMD* __restrict x, const SIMD* __restrict y, const SIMD* __restrict z)
+{
+	uSIMDi ix0[U], iy0[U], iz0[U];
+	SIMDi ix1[U], iy1[U], iz1[U];
+	SIMD fx0[U], fy0[U], fz0[U];
+	SIMD fx1[U], fy1[U], fz1[U];
+	SIMD r[U], t[U], s[U];
+	uSIMDi p[8][U];
+
+	for (int u = 0; u < U; u++)
+	{
+#ifdef SSE41
+		ix0[u].m = ConvertToInt(Floor(x[u]));
+		iy0[u].m = ConvertToInt(Floor(y[u]));
+		iz0[u].m = ConvertToInt(Floor(z[u]));
+#endif
+#ifndef SSE41
+		const uSIMD* ux = (const uSIMD*)&x[u];
+		const uSIMD* uy = (const uSIMD*)&y[u];
+		const uSIMD* uz = (const uSIMD*)&z[u];
+		for (int i = 0; i < VECTOR_SIZE; i++)
+		{
+			ix0[u].a[i] = fastFloor((*ux).a[i]);
+			iy0[u].a[i] = fastFloor((*uy).a[i]);
+			iz0[u].a[i] = fastFloor((*uz).a[i]);
+		}
+#endif
+	}
+
+	for (int u = 0; u < U; u++)
+	{
+		fx0[u] = Sub(x[u], ConvertToFloat(ix0[u].m));
+		fy0[u] = Sub(y[u], ConvertToFloat(iy0[u].m));
+		fz0[u] = Sub(z[u], ConvertToFloat(iz0[u].m));
+
+		fx1[u] = Sub(fx0[u], onef);
+		fy1[u] = Sub(fy0[u], onef);
+		fz1[u] = Sub(fz0[u], onef);
+
+		ix1[u] = Andi(Addi(ix0[u].m, one), ff);
+		iy1[u] = Andi(Addi(iy0[u].m, one), ff);
+		iz1[u] = Andi(Addi(iz0[u].m, one), ff);
+
+		ix0[u].m = Andi(ix0[u].m, ff);
+		iy0[u].m = Andi(iy0[u].m, ff);
+		iz0[u].m = Andi(iz0[u].m, ff);
+	}
+
+	if (QUALITY != QUALITY_REFERENCE)
+	{
+		for (int u = 0; u < U; u++)
+		{
+			SIMDi h[8];
+			if (QUALITY == QUALITY_FAST) perlinPermHashSIMD3d<GATHER>(h, ix0[u].m, ix1[u], iy0[u].m, iy1[u], iz0[u].m, iz1[u]);
+			else perlinHashSIMD3d(h, ix0[u].m, ix1[u], iy0[u].m, iy1[u], iz0[u].m, iz1[u]);
+			for (int k = 0; k < 8; k++) p[k][u].m = h[k];
+		}
+	}
+	else
+#ifdef USEGATHER
+	if (GATHER)
+	{
+		SIMDi pz0[U], pz1[U];
+		SIMDi pz0y0[U], pz0y1[U], pz1y0[U], pz1y1[U];
+		for (int u = 0; u < U; u++)
+		{
+			pz0[u] = Gather(perm, iz0[u].m, 4);
+			pz1[u] = Gather(perm, iz1[u], 4);
+		}
+		for (int u = 0; u < U; u++)
+		{
+			pz0y0[u] = Gather(perm, Addi(iy0[u].m, pz0[u]), 4);
+			pz0y1[u] = Gather(perm, Addi(iy1[u], pz0[u]), 4);
+			pz1y0[u] = Gather(perm, Addi(iy0[u].m, pz1[u]), 4);
+			pz1y1[u] = Gather(perm, Addi(iy1[u], pz1[u]), 4);
+		}
+		for (int u = 0; u < U; u++)
+		{
+			p[0][u].m = Gather(perm, Addi(ix0[u].m, pz0y0[u]), 4);
+			p[1][u].m = Gather(perm, Addi(ix0[u].m, pz1y0[u]), 4);
+			p[2][u].m = Gather(perm, Addi(ix0[u].m, pz0y1[u]), 4);
+			p[3][u].m = Gather(perm, Addi(ix0[u].m, pz1y1[u]), 4);
+			p[4][u].m = Gather(perm, Addi(ix1[u], pz0y0[u]), 4);
+			p[5][u].m = Gather(perm, Addi(ix1[u], pz1y0[u]), 4);
+			p[6][u].m = Gather(perm, Addi(ix1[u], pz0y1[u]), 4);
+			p[7][u].m = Gather(perm, Addi(ix1[u], pz1y1[u]), 4);
+		}
+	}
+	else
+#endif
+	{
+		for (int u = 0; u < U; u++)
+		{
+			uSIMDi ux1, uy1, uz1;
+			ux1.m = ix1[u];
+			uy1.m = iy1[u];
+			uz1.m = iz1[u];
+			for (int i = 0; i < VECTOR_SIZE; i++)
+			{
+				p[0][u].a[i] = perm[ix0[u].a[i] + perm[iy0[u].a[i] + perm[iz0[u].a[i]]]];
+				p[1][u].a[i] = perm[ix0[u].a[i] + perm[iy0[u].a[i] + perm[uz1.a[i]]]];
+				p[2][u].a[i] = perm[ix0[u].a[i] + perm[uy1.a[i] + perm[iz0[u].a[i]]]];
+				p[3][u].a[i] = perm[ix0[u].a[i] + perm[uy1.a[i] + perm[uz1.a[i]]]];
+				p[4][u].a[i] = perm[ux1.a[i] + perm[iy0[u].a[i] + perm[iz0[u].a[i]]]];
+				p[5][u].a[i] = perm[ux1.a[i] + perm[iy0[u].a[i] + perm[uz1.a[i]]]];
+				p[6][u].a[i] = perm[ux1.a[i] + perm[uy1.a[i] + perm[iz0[u].a[i]]]];
+				p[7][u].a[i] = perm[ux1.a[i] + perm[uy1.a[i] + perm[uz1.a[i]]]];
+			}
+		}
+	}
+
+	//fades are independent of the lookups above
+	for (int u = 0; u < U; u++)
+	{
+		r[u] = fadeSIMD3d<QUALITY>(fz0[u]);
+		t[u] = fadeSIMD3d<QUALITY>(fy0[u]);
+		s[u] = fadeSIMD3d<QUALITY>(fx0[u]);
+	}
+
+	for (int u = 0; u < U; u++)
+	{
+		SIMD nxy0 = perlinGradSIMD3d<QUALITY>(p[0][u].m, fx0[u], fy0[u], fz0[u]);
+		SIMD nxy1 = perlinGradSIMD3d<QUALITY>(p[1][u].m, fx0[u], fy0[u], fz1[u]);
+		SIMD nx0 = Add(nxy0, Mul(r[u], Sub(nxy1, nxy0)));
+
+		nxy0 = perlinGradSIMD3d<QUALITY>(p[2][u].m, fx0[u], fy1[u], fz0[u]);
+		nxy1 = perlinGradSIMD3d<QUALITY>(p[3][u].m, fx0[u], fy1[u], fz1[u]);
+		SIMD nx1 = Add(nxy0, Mul(r[u], Sub(nxy1, nxy0)));
+
+		SIMD n0 = Add(nx0, Mul(t[u], Sub(nx1, nx0)));
+
+		nxy0 = perlinGradSIMD3d<QUALITY>(p[4][u].m, fx1[u], fy0[u], fz0[u]);
+		nxy1 = perlinGradSIMD3d<QUALITY>(p[5][u].m, fx1[u], fy0[u], fz1[u]);
+		nx0 = Add(nxy0, Mul(r[u], Sub(nxy1, nxy0)));
+
+		nxy0 = perlinGradSIMD3d<QUALITY>(p[6][u].m, fx1[u], fy1[u], fz0[u]);
+		nxy1 = perlinGradSIMD3d<QUALITY>(p[7][u].m, fx1[u], fy1[u], fz1[u]);
+		nx1 = Add(nxy0, Mul(r[u], Sub(nxy1, nxy0)));
+
+		SIMD n1 = Add(nx0, Mul(t[u], Sub(nx1, nx0)));
+
+		out[u] = Mul(Sub(Add(n0, Mul(s[u], Sub(n1, n0))), poffset), pscale);
+	}
+}
+
+//The vectors are evaluated back to back, they share no data so the cpu can
+//overlap them, and the indirect call is paid once per KERNEL_UNROLL vectors
+template<bool GATHER, int QUALITY>
+inline void simplexSIMD3dNT(SIMD* __restrict out, const SIMD* __restrict x, const SIMD* __restrict y, const SIMD* __restrict z)
+{
+	for (int u = 0; u < KERNEL_UNROLL; u++)
+	{
+		SIMD vx = x[u];
+		SIMD vy = y[u];
+		SIMD vz = z[u];
+		out[u] = simplexSIMD3dT<GATHER, QUALITY>(&vx, &vy, &vz);
+	}
+}
+
+//KERNEL_UNROLL vectors as KERNEL_UNROLL/U groups of U interleaved ones
+template<int U, bool GATHER, int QUALITY>
+inline void perlinSIMD3dNT(SIMD* __restrict out, const SIMD* __restrict x, const SIMD* __restrict y, const SIMD* __restrict z)
+{
+	for (int g = 0; g < KERNEL_UNROLL; g += U) perlinGroupSIMD3d<U, GATHER, QUALITY>(out + g, x + g, y + g, z + g);
+}
+
+inline void perlinSIMD3dN(SIMD* __restrict out, const SIMD* __restrict x, const SIMD* __restrict y, const SIMD* __restrict z)
+{
+	perlinSIMD3dNT<KERNEL_UNROLL, GATHER_DEFAULT, QUALITY_REFERENCE>(out, x, y, z);
+}
+
+inline void simplexSIMD3dN(SIMD* __restrict out, const SIMD* __restrict x, const SIMD* __restrict y, const SIMD* __restrict z)
+{
+	simplexSIMD3dNT<GATHER_DEFAULT, QUALITY_REFERENCE>(out, x, y, z);
+}
+
+template<int QUALITY>
+ISIMDNoise3d selectNoiseKernelT(int noiseType, bool gather)
+{
+	if (noiseType == SIMPLEX) return gather ? simplexSIMD3dT<true, QUALITY> : simplexSIMD3dT<false, QUALITY>;
+	return gather ? perlinSIMD3dT<true, QUALITY> : perlinSIMD3dT<false, QUALITY>;
+}
+
+template<int QUALITY>
+ISIMDNoise3dN selectNoiseKernelNT(int noiseType, int unroll, bool gather)
+{
+	if (noiseType == SIMPLEX) return gather ? simplexSIMD3dNT<true, QUALITY> : simplexSIMD3dNT<false, QUALITY>;
+	switch (unroll)
+	{
+	case 1: return gather ? perlinSIMD3dNT<1, true, QUALITY> : perlinSIMD3dNT<1, false, QUALITY>;
+	case 2: return gather ? perlinSIMD3dNT<2, true, QUALITY> : perlinSIMD3dNT<2, false, QUALITY>;
+	case 4: return gather ? perlinSIMD3dNT<4, true, QUALITY> : perlinSIMD3dNT<4, false, QUALITY>;
+	default: return gather ? perlinSIMD3dNT<KERNEL_UNROLL, true, QUALITY> : perlinSIMD3dNT<KERNEL_UNROLL, false, QUALITY>;
+	}
+}
+
+ISIMDNoise3d SelectNoiseKernel(int noiseType, bool gather, int quality)
+{
+#ifndef USEGATHER
+	gather = false;
+#endif
+	switch (quality)
+	{
+	case QUALITY_FAST: return selectNoiseKernelT<QUALITY_FAST>(noiseType, gather);
+	case QUALITY_FASTEST: return selectNoiseKernelT<QUALITY_FASTEST>(noiseType, gather);
+	default: return selectNoiseKernelT<QUALITY_REFERENCE>(noiseType, gather);
+	}
+}
+
+ISIMDNoise3dN SelectNoiseKernelN(int noiseType, int unroll, bool gather, int quality)
+{
+#ifndef USEGATHER
+	gather = false;
+#endif
+	//groups must tile KERNEL_UNROLL exactly
+	if (unroll < 1 || unroll > KERNEL_UNROLL || KERNEL_UNROLL % unroll != 0) unroll = KERNEL_UNROLL;
+	switch (quality)
+	{
+	case QUALITY_FAST: return selectNoiseKernelNT<QUALITY_FAST>(noiseType, unroll, gather);
+	case QUALITY_FASTEST: return selectNoiseKernelNT<QUALITY_FASTEST>(noiseType, unroll, gather);
+	default: return selectNoiseKernelNT<QUALITY_REFERENCE>(noiseType, unroll, gather);
+	}
+}
+
+//The noise at the center can change by at most lipschitz * radius (plus the steps of
+//simplex) anywhere in the ball, and never leaves the range of one octave
+inline void noiseBoundSIMD3d(SIMD* lo, SIMD* hi, SIMD n, SIMD radius, float lipschitz, float step, float bound)
+{
+	SIMD spread = Add(Mul(radius, SetOne(lipschitz)), SetOne(step + NOISE_BOUND_EPSILON));
+	*lo = Max(Sub(n, spread), SetOne(-bound));
+	*hi = Min(Add(n, spread), SetOne(bound));
+}
+
+//The cheaper tiers stay within the range and slope limits of the reference (see README)
+template<int QUALITY>
+void perlinBoundSIMD3dT(SIMD* lo, SIMD* hi, SIMD* x, SIMD* y, SIMD* z, SIMD* radius)
+{
+	noiseBoundSIMD3d(lo, hi, perlinSIMD3dT<GATHER_DEFAULT, QUALITY>(x, y, z), *radius, PERLIN_LIPSCHITZ, 0, PERLIN_BOUND);
+}
+
+template<int QUALITY>
+void simplexBoundSIMD3dT(SIMD* lo, SIMD* hi, SIMD* x, SIMD* y, SIMD* z, SIMD* radius)
+{
+	noiseBoundSIMD3d(lo, hi, simplexSIMD3dT<GATHER_DEFAULT, QUALITY>(x, y, z), *radius, SIMPLEX_LIPSCHITZ, SIMPLEX_STEP, SIMPLEX_BOUND);
+}
+
+void perlinBoundSIMD3d(SIMD* lo, SIMD* hi, SIMD* x, SIMD* y, SIMD* z, SIMD* radius)
+{
+	perlinBoundSIMD3dT<QUALITY_REFERENCE>(lo, hi, x, y, z, radius);
+}
+
+void simplexBoundSIMD3d(SIMD* lo, SIMD* hi, SIMD* x, SIMD* y, SIMD* z, SIMD* radius)
+{
+	simplexBoundSIMD3dT<QUALITY_REFERENCE>(lo, hi, x, y, z, radius);
+}
+
+ISIMDNoiseBound3d SelectNoiseBound(int noiseType, int quality)
+{
+	switch (quality)
+	{
+	case QUALITY_FAST: return noiseType == SIMPLEX ? simplexBoundSIMD3dT<QUALITY_FAST> : perlinBoundSIMD3dT<QUALITY_FAST>;
+	case QUALITY_FASTEST: return noiseType == SIMPLEX ? simplexBoundSIMD3dT<QUALITY_FASTEST> : perlinBoundSIMD3dT<QUALITY_FASTEST>;
+	default: return noiseType == SIMPLEX ? simplexBoundSIMD3d : perlinBoundSIMD3d;
+	}
+}
+
+
+
+//---------------------------------------------------------------------
+//16 bit fixed point Perlin noise. Hashing stays in 32 bit lanes, everything after it
+//works on 2*VECTOR_SIZE 16 bit lanes: corner offsets are Q14, fades Q15.
+
+#ifdef SSE41
+//perm[i] | perm[i+1] << 16, the hashes of both cells along an axis in one lookup
+static int32_t permPair[512];
+static bool permPairReady = [] {
+	for (int i = 0; i < 512; i++) permPair[i] = perm[i] | perm[(i + 1) & 511] << 16;
+	return true;
+}();
+
+//Corner hashes and Q14 fractional parts of one vector of points. p[i] holds the hash of
+//corner i of perlinSIMD3dT in its low 16 bits and that of corner i+4 in the high ones.
+template<bool GATHER>
+inline void perlinCellSIMD3d(SIMDi* p, SIMDi* fx, SIMDi* fy, SIMDi* fz, const SIMD* x, const SIMD* y, const SIMD* z)
+{
+	uSIMDi ix0, iy0, iz0;
+	SIMD flx = Floor(*x);
+	SIMD fly = Floor(*y);
+	SIMD flz = Floor(*z);
+	SIMD q14 = SetOne(16384.0f);
+	*fx = TruncateToInt(Mul(Sub(*x, flx), q14));
+	*fy = TruncateToInt(Mul(Sub(*y, fly), q14));
+	*fz = TruncateToInt(Mul(Sub(*z, flz), q14));
+
+	ix0.m = ConvertToInt(flx);
+	iy0.m = ConvertToInt(fly);
+	iz0.m = ConvertToInt(flz);
+	ix0.m = Andi(ix0.m, ff);
+	iy0.m = Andi(iy0.m, ff);
+	iz0.m = Andi(iz0.m, ff);
+
+	//each permPair lookup gives the hashes of both neighbours along an axis, 7 lookups instead of 14
+#ifdef USEGATHER
+	if (GATHER)
+	{
+		SIMDi low = SetOnei(0xffff);
+		SIMDi pz = Gather(permPair, iz0.m, 4);
+		SIMDi pz0 = Andi(pz, low);
+		SIMDi pz1 = ShiftRighti(pz, 16);
+		SIMDi pyz0 = Gather(permPair, Addi(iy0.m, pz0), 4);
+		SIMDi pyz1 = Gather(permPair, Addi(iy0.m, pz1), 4);
+		SIMDi pz0y0 = Andi(pyz0, low);
+		SIMDi pz0y1 = ShiftRighti(pyz0, 16);
+		SIMDi pz1y0 = Andi(pyz1, low);
+		SIMDi pz1y1 = ShiftRighti(pyz1, 16);
+		//p[i] and p[i+4] share a gather, split in perlinSIMD3dI16T
+		p[0] = Gather(permPair, Addi(ix0.m, pz0y0), 4);
+		p[1] = Gather(permPair, Addi(ix0.m, pz1y0), 4);
+		p[2] = Gather(permPair, Addi(ix0.m, pz0y1), 4);
+		p[3] = Gather(permPair, Addi(ix0.m, pz1y1), 4);
+		return;
+	}
+#endif
+	uSIMDi h[4];
+	for (int i = 0; i < VECTOR_SIZE; i++)
+	{
+		int pz = permPair[iz0.a[i]];
+		int pyz0 = permPair[iy0.a[i] + (pz & 0xffff)];
+		int pyz1 = permPair[iy0.a[i] + (pz >> 16)];
+		h[0].a[i] = permPair[ix0.a[i] + (pyz0 & 0xffff)];
+		h[1].a[i] = permPair[ix0.a[i] + (pyz1 & 0xffff)];
+		h[2].a[i] = permPair[ix0.a[i] + (pyz0 >> 16)];
+		h[3].a[i] = permPair[ix0.a[i] + (pyz1 >> 16)];
+	}
+	for (int i = 0; i < 4; i++) p[i] = h[i].m;
+}
+
+//gradSIMD3d on 16 bit lanes, h already reduced to 0-15
+inline SIMDi gradSIMD3dI16(const SIMDi &h, const SIMDi &x, const SIMDi &y, const SIMDi &z)
+{
+	SIMDi u = Selecti(LessThan16(h, SetOne16(8)), x, y);
+	SIMDi h12o14 = Ori(Equal16(h, SetOne16(12)), Equal16(h, SetOne16(14)));
+	SIMDi v = Selecti(LessThan16(h, SetOne16(4)), y, Selecti(h12o14, x, z));
+	//bit 0 and bit 1 of h moved up to the sign bit, the 1 keeps the sign from being 0
+	u = Sign16(u, Ori(ShiftLeft16(h, 15), SetOne16(1)));
+	v = Sign16(v, Ori(ShiftLeft16(h, 14), SetOne16(1)));
+	return Add16(u, v);
+}
+
+//6t^5-15t^4+10t^3 written as 1/2 + u(15/16 - 5/8 w + 3/16 w^2) with u = 2t-1 and w = u^2,
+//so every constant and every step stays within Q15. t is Q14 below 1, the result Q15.
+inline SIMDi fadeSIMD3dI16(const SIMDi &t)
+{
+	//2t - 1 in Q15 is (t << 2) - 32768, which wraps back into range. -1 itself is kept
+	//out since mulhrs(-1,-1) overflows
+	SIMDi u = Max16(Add16(ShiftLeft16(t, 2), SetOne16(-32768)), SetOne16(-32767));
+	SIMDi w = MulFixed16(u, u);
+	SIMDi p = Add16(MulFixed16(w, SetOne16(6144)), SetOne16(-20480));
+	p = Add16(MulFixed16(w, p), SetOne16(30720));
+	return AddSat16(MulFixed16(u, p), SetOne16(16384));
+}
+
+//a + t(b - a) for Q14 a and b. b - a can need 17 bits, so it is a - ta + tb instead,
+//whose intermediate sums may wrap but always come back to the in range result
+inline SIMDi lerpSIMD3dI16(const SIMDi &t, const SIMDi &a, const SIMDi &b)
+{
+	return Add16(a, Sub16(MulFixed16(b, t), MulFixed16(a, t)));
+}
+
+template<bool GATHER>
+inline void perlinSIMD3dI16T(int16_t* __restrict out, const SIMD* __restrict x, const SIMD* __restrict y, const SIMD* __restrict z)
+{
+	SIMDi pa[4], pb[4], fa[3], fb[3];
+	perlinCellSIMD3d<GATHER>(pa, &fa[0], &fa[1], &fa[2], x, y, z);
+	perlinCellSIMD3d<GATHER>(pb, &fb[0], &fb[1], &fb[2], x + 1, y + 1, z + 1);
+
+	//a fraction of exactly 1 after rounding is kept just below it
+	SIMDi below = SetOne16(16383);
+	SIMDi fx0 = Min16(Pack16(fa[0], fb[0]), below);
+	SIMDi fy0 = Min16(Pack16(fa[1], fb[1]), below);
+	SIMDi fz0 = Min16(Pack16(fa[2], fb[2]), below);
+	SIMDi fx1 = Sub16(fx0, SetOne16(16384));
+	SIMDi fy1 = Sub16(fy0, SetOne16(16384));
+	SIMDi fz1 = Sub16(fz0, SetOne16(16384));
+
+	SIMDi h[8];
+	SIMDi low = SetOnei(0xffff);
+	for (int i = 0; i < 4; i++)
+	{
+		h[i] = Andi(Pack16(Andi(pa[i], low), Andi(pb[i], low)), SetOne16(15));
+		h[i + 4] = Andi(Pack16(ShiftRighti(pa[i], 16), ShiftRighti(pb[i], 16)), SetOne16(15));
+	}
+
+	SIMDi r = fadeSIMD3dI16(fz0);
+	SIMDi t = fadeSIMD3dI16(fy0);
+	SIMDi s = fadeSIMD3dI16(fx0);
+
+	SIMDi nx0 = lerpSIMD3dI16(r, gradSIMD3dI16(h[0], fx0, fy0, fz0), gradSIMD3dI16(h[1], fx0, fy0, fz1));
+	SIMDi nx1 = lerpSIMD3dI16(r, gradSIMD3dI16(h[2], fx0, fy1, fz0), gradSIMD3dI16(h[3], fx0, fy1, fz1));
+	SIMDi n0 = lerpSIMD3dI16(t, nx0, nx1);
+
+	nx0 = lerpSIMD3dI16(r, gradSIMD3dI16(h[4], fx1, fy0, fz0), gradSIMD3dI16(h[5], fx1, fy0, fz1));
+	nx1 = lerpSIMD3dI16(r, gradSIMD3dI16(h[6], fx1, fy1, fz0), gradSIMD3dI16(h[7], fx1, fy1, fz1));
+	SIMDi n1 = lerpSIMD3dI16(t, nx0, nx1);
+
+	//(n - OFFSET) * SCALE, SCALE split into 1 + 0.754 so the multiplier fits Q15
+	SIMDi n = Sub16(lerpSIMD3dI16(s, n0, n1), SetOne16((short)(OFFSET * PERLIN_I16_ONE + 0.5f)));
+	n = AddSat16(n, MulFixed16(n, SetOne16((short)((SCALE - 1.0f) * 32768.0f + 0.5f))));
+	StoreU16(out, n);
+}
+#endif
+#ifndef SSE41
+//No pmulhrsw before SSSE3, round the float kernel instead
+template<bool GATHER>
+inline void perlinSIMD3dI16T(int16_t* __restrict out, const SIMD* __restrict x, const SIMD* __restrict y, const SIMD* __restrict z)
+{
+	for (int half = 0; half < 2; half++)
+	{
+		SIMD hx = x[half], hy = y[half], hz = z[half];
+		uSIMD n;
+		n.m = perlinSIMD3dT<GATHER, QUALITY_REFERENCE>(&hx, &hy, &hz);
+		for (int i = 0; i < VECTOR_SIZE; i++)
+		{
+			float q = n.a[i] * PERLIN_I16_ONE;
+			q = q > 32767.0f ? 32767.0f : (q < -32768.0f ? -32768.0f : q);
+			out[half*VECTOR_SIZE + i] = (int16_t)(q < 0 ? q - 0.5f : q + 0.5f);
+		}
+	}
+}
+#endif
+
+void perlinSIMD3dI16(int16_t* __restrict out, const SIMD* __restrict x, const SIMD* __restrict y, const SIMD* __restrict z)
+{
+	perlinSIMD3dI16T<GATHER_DEFAULT>(out, x, y, z);
+}
 
 
 //---------------------------------------------------------------------
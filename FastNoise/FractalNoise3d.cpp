@@ -150,3 +150,186 @@
 	return sum;
 }
 
+
+
+
+//Multi vector versions, KERNEL_UNROLL coordinate vectors go through every octave together
+ void plainSIMD3dN(SIMD* out, const SIMD* x, const SIMD* y, const SIMD* z, const Settings* S, ISIMDNoise3dN noise)
+{
+	SIMD vfx[KERNEL_UNROLL], vfy[KERNEL_UNROLL], vfz[KERNEL_UNROLL];
+	for (int u = 0; u < KERNEL_UNROLL; u++)
+	{
+		vfx[u] = Mul(x[u], S->frequency);
+		vfy[u] = Mul(y[u], S->frequency);
+		vfz[u] = Mul(z[u], S->frequency);
+	}
+	noise(out, vfx, vfy, vfz);
+}
+
+ void ridgePlainSIMD3dN(SIMD* out, const SIMD* x, const SIMD* y, const SIMD* z, const Settings* S, ISIMDNoise3dN noise)
+{
+	plainSIMD3dN(out, x, y, z, S, noise);
+	for (int u = 0; u < KERNEL_UNROLL; u++) out[u] = Max(Sub(zero, out[u]), out[u]);
+}
+
+ void fbmSIMD3dN(SIMD* out, const SIMD* x, const SIMD* y, const SIMD* z, const Settings* S, ISIMDNoise3dN noise)
+{
+	SIMD vfx[KERNEL_UNROLL], vfy[KERNEL_UNROLL], vfz[KERNEL_UNROLL], r[KERNEL_UNROLL];
+	SIMD amplitude = SetOne(1);
+	SIMD localFrequency = S->frequency;
+	for (int u = 0; u < KERNEL_UNROLL; u++) out[u] = SetZero();
+	for (int i = S->octaves; i != 0; i--)
+	{
+		for (int u = 0; u < KERNEL_UNROLL; u++)
+		{
+			vfx[u] = Mul(x[u], localFrequency);
+			vfy[u] = Mul(y[u], localFrequency);
+			vfz[u] = Mul(z[u], localFrequency);
+		}
+		noise(r, vfx, vfy, vfz);
+		for (int u = 0; u < KERNEL_UNROLL; u++) out[u] = Add(out[u], Mul(amplitude, r[u]));
+		localFrequency = Mul(localFrequency, S->lacunarity);
+		amplitude = Mul(amplitude, S->gain);
+	}
+}
+
+ void turbulenceSIMD3dN(SIMD* out, const SIMD* x, const SIMD* y, const SIMD* z, const Settings* S, ISIMDNoise3dN noise)
+{
+	SIMD vfx[KERNEL_UNROLL], vfy[KERNEL_UNROLL], vfz[KERNEL_UNROLL], r[KERNEL_UNROLL];
+	SIMD amplitude = SetOne(1.0f);
+	SIMD localFrequency = S->frequency;
+	for (int u = 0; u < KERNEL_UNROLL; u++) out[u] = SetZero();
+	for (int i = S->octaves; i != 0; i--)
+	{
+		for (int u = 0; u < KERNEL_UNROLL; u++)
+		{
+			vfx[u] = Mul(x[u], localFrequency);
+			vfy[u] = Mul(y[u], localFrequency);
+			vfz[u] = Mul(z[u], localFrequency);
+		}
+		noise(r, vfx, vfy, vfz);
+		for (int u = 0; u < KERNEL_UNROLL; u++)
+		{
+			SIMD a = Mul(amplitude, r[u]);
+			out[u] = Add(out[u], Max(Sub(zero, a), a));
+		}
+		localFrequency = Mul(localFrequency, S->lacunarity);
+		amplitude = Mul(amplitude, S->gain);
+	}
+}
+
+ void ridgeSIMD3dN(SIMD* out, const SIMD* x, const SIMD* y, const SIMD* z, const Settings* S, ISIMDNoise3dN noise)
+{
+	SIMD vfx[KERNEL_UNROLL], vfy[KERNEL_UNROLL], vfz[KERNEL_UNROLL], r[KERNEL_UNROLL], prev[KERNEL_UNROLL];
+	SIMD amplitude = SetOne(1.0f);
+	SIMD localFrequency = S->frequency;
+	for (int u = 0; u < KERNEL_UNROLL; u++)
+	{
+		out[u] = SetZero();
+		prev[u] = SetOne(1.0f);
+	}
+	for (int i = S->octaves; i != 0; i--)
+	{
+		for (int u = 0; u < KERNEL_UNROLL; u++)
+		{
+			vfx[u] = Mul(x[u], localFrequency);
+			vfy[u] = Mul(y[u], localFrequency);
+			vfz[u] = Mul(z[u], localFrequency);
+		}
+		noise(r, vfx, vfy, vfz);
+		for (int u = 0; u < KERNEL_UNROLL; u++)
+		{
+			SIMD a = Max(Sub(zero, r[u]), r[u]);
+			a = Sub(S->offset, a);
+			a = Mul(a, a);
+			a = Mul(a, amplitude);
+			a = Mul(a, prev[u]);
+			out[u] = Add(out[u], a);
+			prev[u] = a;
+		}
+		localFrequency = Mul(localFrequency, S->lacunarity);
+		amplitude = Mul(amplitude, S->gain);
+	}
+}
+
+
+
+//Interval arithmetic for the bounds, lo..hi times lo2..hi2 has its extremes among the endpoint products
+static inline void mulBound(SIMD* lo, SIMD* hi, SIMD lo2, SIMD hi2)
+{
+	SIMD a = Mul(*lo, lo2);
+	SIMD b = Mul(*lo, hi2);
+	SIMD c = Mul(*hi, lo2);
+	SIMD d = Mul(*hi, hi2);
+	*lo = Min(Min(a, b), Min(c, d));
+	*hi = Max(Max(a, b), Max(c, d));
+}
+
+//|v| for v in lo..hi, zero is the minimum when the interval straddles it
+static inline void absBound(SIMD* lo, SIMD* hi)
+{
+	SIMD l = Max(Max(*lo, Sub(zero, *hi)), zero);
+	*hi = Max(Sub(zero, *lo), *hi);
+	*lo = l;
+}
+
+//Bounds of the fractal over balls of radius around S->x,y,z, radius in the same units.
+//Every octave is bounded on its own and the bounds are combined the way the fractal
+//combines the octaves, so it holds for any gain and offset.
+ void fractalBoundSIMD3d(SIMD* lo, SIMD* hi, Settings* S, SIMD radius, int fractalType, ISIMDNoiseBound3d bound)
+{
+	//single octaves are plain, and abs of plain for ridge, as in SelectFractalSIMD
+	int octaves = fractalType == PLAIN ? 1 : S->octaves;
+	if (octaves == 1) fractalType = fractalType == RIDGE ? -RIDGE : PLAIN;
+	SIMD amplitude = SetOne(1.0f);
+	SIMD localFrequency = S->frequency;
+	SIMD prevLo = SetOne(1.0f);
+	SIMD prevHi = SetOne(1.0f);
+	*lo = SetZero();
+	*hi = SetZero();
+	for (int i = octaves; i != 0; i--)
+	{
+		SIMD vfx = Mul(S->x.m, localFrequency);
+		SIMD vfy = Mul(S->y.m, localFrequency);
+		SIMD vfz = Mul(S->z.m, localFrequency);
+		SIMD r = Mul(radius, localFrequency);
+		SIMD nlo, nhi;
+		bound(&nlo, &nhi, &vfx, &vfy, &vfz, &r);
+		switch (fractalType)
+		{
+		case FBM:
+			mulBound(&nlo, &nhi, amplitude, amplitude);
+			break;
+		case TURBULENCE:
+			mulBound(&nlo, &nhi, amplitude, amplitude);
+			absBound(&nlo, &nhi);
+			break;
+		case RIDGE:
+		{
+			//(offset - |n|)^2 * amplitude * previous octave
+			absBound(&nlo, &nhi);
+			SIMD t = Sub(S->offset, nhi);
+			nhi = Sub(S->offset, nlo);
+			nlo = t;
+			absBound(&nlo, &nhi);
+			mulBound(&nlo, &nhi, nlo, nhi);
+			mulBound(&nlo, &nhi, amplitude, amplitude);
+			mulBound(&nlo, &nhi, prevLo, prevHi);
+			prevLo = nlo;
+			prevHi = nhi;
+			break;
+		}
+		case -RIDGE:
+			absBound(&nlo, &nhi);
+			break;
+		}
+		*lo = Add(*lo, nlo);
+		*hi = Add(*hi, nhi);
+		localFrequency = Mul(localFrequency, S->lacunarity);
+		amplitude = Mul(amplitude, S->gain);
+	}
+	//rounding of the sums and products
+	SIMD eps = SetOne(NOISE_BOUND_EPSILON);
+	*lo = Sub(*lo, Mul(eps, Add(Max(Sub(zero, *lo), *lo), onef)));
+	*hi = Add(*hi, Mul(eps, Add(Max(Sub(zero, *hi), *hi), onef)));
+}
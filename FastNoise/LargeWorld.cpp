@@ -0,0 +1,124 @@
+#include "headers\LargeWorld.h"
+#include "headers\TileScheduler.h"
+#include <math.h>
+
+//Large worlds keep the tile origin in double precision. For every octave the
+//origin is scaled by that octave's frequency and wrapped by the noise period
+//in double, so the floats handed to the SIMD kernels stay small and keep
+//their fractional precision no matter how far the tile is from 0.
+
+
+static void fractalWorldSIMD(SIMD* out, Settings* S, const SIMD* origins, int fractalType, ISIMDNoise3d noise)
+{
+	FractalAccumulator A;
+	BeginFractal(&A, fractalType, S->octaves);
+	SIMD localFrequency = S->frequency;
+	for (int i = 0; i < S->octaves; i++)
+	{
+		SIMD vfx = Add(Mul(S->x.m, localFrequency), origins[3 * i]);
+		SIMD vfy = Add(Mul(S->y.m, localFrequency), origins[3 * i + 1]);
+		SIMD vfz = Add(Mul(S->z.m, localFrequency), origins[3 * i + 2]);
+		AddOctave(&A, noise(&vfx, &vfy, &vfz), S->gain, S->offset);
+		localFrequency = Mul(localFrequency, S->lacunarity);
+	}
+	*out = A.out;
+}
+
+struct WorldContext
+{
+	float* result;
+	const Settings* S;
+	const SIMD* origins;
+	int fractalType;
+	ISIMDNoise3d noiseFunction;
+	float spacing;
+	int width;
+	float* chunkMin;
+	float* chunkMax;
+};
+
+static void worldChunk(void* context, int begin, int end, int chunk)
+{
+	WorldContext* C = (WorldContext*)context;
+	Settings S = *C->S;
+	uSIMD lanes;
+	for (int j = 0; j < VECTOR_SIZE; j++) lanes.a[j] = (float)j;
+
+	SIMD min = SetOne(999);
+	SIMD max = SetOne(-999);
+	S.z.m = SetZero();
+	for (int y = begin; y < end; y++)
+	{
+		S.y.m = SetOne(y * C->spacing);
+		for (int x = 0; x < C->width; x = x + VECTOR_SIZE)
+		{
+			//lanes past the end repeat the last column
+			S.x.m = Mul(Min(Add(SetOne((float)x), lanes.m), SetOne((float)(C->width - 1))), SetOne(C->spacing));
+			SIMD r;
+			fractalWorldSIMD(&r, &S, C->origins, C->fractalType, C->noiseFunction);
+			min = Min(min, r);
+			max = Max(max, r);
+			int count = C->width - x < VECTOR_SIZE ? C->width - x : VECTOR_SIZE;
+			StorePartial(C->result + (size_t)y*C->width + x, r, count);
+		}
+	}
+	ReduceMinMax(&min, &max, &C->chunkMin[chunk], &C->chunkMax[chunk]);
+}
+
+static float wrapOrigin(double origin, float frequency, double period)
+{
+	double o = origin * frequency;
+	return (float)(o - period * floor(o / period));
+}
+
+//Fills a width x height tile of the z = originZ plane, sample x,y is at
+//origin + (x*spacing, y*spacing, 0) in world units
+bool FillWorldTileSIMD(float* result, const NoiseParams* P, double originX, double originY, double originZ, float spacing, int width, int height, float* __restrict outMin, float* __restrict outMax)
+{
+	FIXED_FLOAT_STATE();
+	ISIMDNoise3d noiseFunction;
+	if (!SelectNoiseSIMD(P->noiseType, &noiseFunction, P->quality)) return false;
+	if (P->fractalType < FBM || P->fractalType > PLAIN || P->octaves < 1 || width < 1 || height < 1) return false;
+
+	int octaves = P->fractalType == PLAIN ? 1 : P->octaves;
+	double period = P->noiseType == SIMPLEX ? SIMPLEX_PERIOD : PERLIN_PERIOD;
+
+	float seedX, seedY, seedZ;
+	SeedOffset(P->seed, &seedX, &seedY, &seedZ);
+
+	Settings S;
+	initSIMD(&S, P->frequency, P->lacunarity, P->offset, P->gain, octaves);
+
+	//per octave origins, following the same float frequency sequence as the kernels
+	SIMD* origins = (SIMD*)_aligned_malloc(3 * octaves*sizeof(SIMD), MEMORY_ALIGNMENT);
+	float frequency = P->frequency;
+	for (int i = 0; i < octaves; i++)
+	{
+		origins[3 * i] = SetOne(wrapOrigin(originX + seedX, frequency, period));
+		origins[3 * i + 1] = SetOne(wrapOrigin(originY + seedY, frequency, period));
+		origins[3 * i + 2] = SetOne(wrapOrigin(originZ + seedZ, frequency, period));
+		frequency = frequency * P->lacunarity;
+	}
+
+	int grain = GetSchedulerGrain();
+	int chunks = ChunkCount(height, grain);
+	WorldContext C = { result, &S, origins, P->fractalType, noiseFunction, spacing, width, new float[chunks], new float[chunks] };
+	ParallelFor(height, grain, worldChunk, &C);
+
+	ReduceChunkMinMax(C.chunkMin, C.chunkMax, chunks, outMin, outMax);
+	delete[] C.chunkMin;
+	delete[] C.chunkMax;
+	_aligned_free(origins);
+	return true;
+}
+
+//Same as FillWorldTileSIMD with the origin given as an integer lattice
+//position plus a float offset from it, both in world units
+bool FillWorldTileLatticeSIMD(float* result, const NoiseParams* P, const int64_t* latticeOrigin, const float* localOrigin, float spacing, int width, int height, float* __restrict outMin, float* __restrict outMax)
+{
+	return FillWorldTileSIMD(result, P,
+		(double)latticeOrigin[0] + localOrigin[0],
+		(double)latticeOrigin[1] + localOrigin[1],
+		(double)latticeOrigin[2] + localOrigin[2],
+		spacing, width, height, outMin, outMax);
+}
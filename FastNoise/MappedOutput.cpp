@@ -0,0 +1,345 @@
+#include "headers\MappedOutput.h"
+#include "headers\TileScheduler.h"
+#include <string.h>
+#include <math.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mutex>
+#include <unordered_map>
+
+//Length of every view MapNoiseFile handed out, the file may run past what its header covers
+static std::mutex mappedLock;
+static std::unordered_map<const void*, size_t> mappedSizes;
+#endif
+
+void GetNoiseRangeBound(const NoiseParams* params, float* rangeMin, float* rangeMax)
+{
+	float n = params->noiseType == SIMPLEX ? SIMPLEX_BOUND : PERLIN_BOUND;
+	int fractalType = params->octaves > 1 ? params->fractalType : (params->fractalType == RIDGE ? TURBULENCE : PLAIN);
+	float amplitude = 1.0f;
+	float sum = 0.0f;
+	float prev = 1.0f;
+	//ridge octaves are (offset - |noise|)^2 * amplitude * previous octave, all positive
+	float q = fmaxf(params->offset * params->offset, (params->offset - n) * (params->offset - n));
+	for (int i = 0; i < params->octaves; i++)
+	{
+		if (fractalType == RIDGE)
+		{
+			prev = q * amplitude * prev;
+			sum += prev;
+		}
+		else sum += n * fabsf(amplitude);
+		amplitude *= params->gain;
+	}
+
+	switch (fractalType)
+	{
+	case FBM:
+		*rangeMin = -sum;
+		*rangeMax = sum;
+		break;
+	case TURBULENCE:
+	case RIDGE:
+		*rangeMin = 0;
+		*rangeMax = sum;
+		break;
+	default:
+		*rangeMin = -n;
+		*rangeMax = n;
+	}
+}
+
+//An open writable mapping of the whole file
+struct MappedFile
+{
+	char* base;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int file;
+#endif
+};
+
+static bool openMapped(MappedFile* M, const char* path, size_t size)
+{
+	M->size = size;
+#ifdef _WIN32
+	M->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (M->file == INVALID_HANDLE_VALUE) return false;
+	M->mapping = CreateFileMappingA(M->file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL);
+	if (!M->mapping)
+	{
+		CloseHandle(M->file);
+		return false;
+	}
+	M->base = (char*)MapViewOfFile(M->mapping, FILE_MAP_WRITE, 0, 0, size);
+	if (!M->base)
+	{
+		CloseHandle(M->mapping);
+		CloseHandle(M->file);
+		return false;
+	}
+#else
+	M->file = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (M->file < 0) return false;
+	if (ftruncate(M->file, (off_t)size) != 0)
+	{
+		close(M->file);
+		return false;
+	}
+	void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, M->file, 0);
+	if (p == MAP_FAILED)
+	{
+		close(M->file);
+		return false;
+	}
+	M->base = (char*)p;
+	//written once front to back
+	madvise(M->base, size, MADV_SEQUENTIAL);
+#endif
+	return true;
+}
+
+//Starts writing back bytes begin..end-1 and lets the pages wholly inside the
+//range leave memory, so maps larger than RAM don't stay resident
+static void flushMapped(const MappedFile* M, size_t begin, size_t end)
+{
+#ifdef _WIN32
+	FlushViewOfFile(M->base + begin, end - begin);
+#else
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t first = begin / page * page;
+	msync(M->base + first, end - first, MS_ASYNC);
+	size_t innerBegin = (begin + page - 1) / page * page;
+	size_t innerEnd = end / page * page;
+	if (innerEnd > innerBegin) madvise(M->base + innerBegin, innerEnd - innerBegin, MADV_DONTNEED);
+#endif
+}
+
+static bool closeMapped(MappedFile* M)
+{
+	bool ok;
+#ifdef _WIN32
+	ok = FlushViewOfFile(M->base, M->size) && FlushFileBuffers(M->file);
+	UnmapViewOfFile(M->base);
+	CloseHandle(M->mapping);
+	CloseHandle(M->file);
+#else
+	ok = msync(M->base, M->size, MS_SYNC) == 0;
+	munmap(M->base, M->size);
+	ok = close(M->file) == 0 && ok;
+#endif
+	return ok;
+}
+
+static size_t sampleCount(int width, int height, int tileSize)
+{
+	if (tileSize <= 0) return (size_t)width*height;
+	size_t tilesX = (width + tileSize - 1) / tileSize;
+	size_t tilesY = (height + tileSize - 1) / tileSize;
+	return tilesX * tilesY * tileSize * tileSize;
+}
+
+struct MappedContext
+{
+	const MappedFile* M;
+	const SphereTable* T;
+	const Settings* S;
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	int format;
+	int tileSize;
+	float rangeMin;
+	float scale;
+	float* chunkMin;
+	float* chunkMax;
+};
+
+//Offset in samples of row y, column x
+static size_t sampleIndex(const MappedContext* C, int x, int y)
+{
+	int width = C->T->width;
+	if (C->tileSize <= 0) return (size_t)y*width + x;
+	size_t ts = C->tileSize;
+	size_t tilesX = (width + ts - 1) / ts;
+	size_t tile = (y / ts) * tilesX + x / ts;
+	return tile * ts * ts + (y % ts) * ts + x % ts;
+}
+
+//One band of rows, for tiled files a band is one row of tiles
+static void mappedChunk(void* context, int begin, int end, int chunk)
+{
+	MappedContext* C = (MappedContext*)context;
+	Settings S = *C->S;
+	int width = C->T->width;
+	size_t sampleSize = C->format == MAPPED_UINT16 ? sizeof(uint16_t) : sizeof(float);
+	char* samples = C->M->base + MAPPED_NOISE_HEADER_SIZE;
+	bool direct = C->format == MAPPED_FLOAT32 && C->tileSize <= 0;
+	float* row = direct ? 0 : (float*)_aligned_malloc(width * sizeof(float), MEMORY_ALIGNMENT);
+
+	SIMD min = SetOne(999);
+	SIMD max = SetOne(-999);
+	for (int y = begin; y < end; y++)
+	{
+		//row major floats go straight into the mapping
+		float* out = direct ? (float*)samples + (size_t)y*width : row;
+		FillSphereRowSIMD(out, C->T, y, 0, width, &S, C->fractalFunction, C->noiseFunction, &min, &max);
+		if (direct) continue;
+
+		int step = C->tileSize > 0 ? C->tileSize : width;
+		for (int x = 0; x < width; x += step)
+		{
+			int count = width - x < step ? width - x : step;
+			size_t index = sampleIndex(C, x, y);
+			if (C->format == MAPPED_FLOAT32)
+			{
+				memcpy((float*)samples + index, row + x, count * sizeof(float));
+				continue;
+			}
+			uint16_t* q = (uint16_t*)samples + index;
+			for (int i = 0; i < count; i++)
+			{
+				float v = (row[x + i] - C->rangeMin) * C->scale;
+				v = v < 0 ? 0 : (v > 65535.0f ? 65535.0f : v);
+				q[i] = (uint16_t)(v + 0.5f);
+			}
+		}
+	}
+	if (row) _aligned_free(row);
+	ReduceMinMax(&min, &max, &C->chunkMin[chunk], &C->chunkMax[chunk]);
+
+	size_t first, last;
+	if (C->tileSize > 0)
+	{
+		first = sampleIndex(C, 0, begin);
+		last = first + sampleCount(width, end - begin, C->tileSize);
+	}
+	else
+	{
+		first = (size_t)begin*width;
+		last = (size_t)end*width;
+	}
+	flushMapped(C->M, MAPPED_NOISE_HEADER_SIZE + first*sampleSize, MAPPED_NOISE_HEADER_SIZE + last*sampleSize);
+}
+
+//Generates a sphere map straight into a file at path, written a band of rows at a
+//time and flushed as bands complete so the whole map never has to be in memory
+bool WriteSphereSurfaceFile(const char* path, const NoiseParams* params, int width, int height, int format, int tileSize, float* outMin, float* outMax)
+{
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	if (!SelectFractalSIMD(params->fractalType, params->octaves, &fractalFunction)) return false;
+	if (!SelectNoiseSIMD(params->noiseType, &noiseFunction, params->quality)) return false;
+	if (params->octaves < 1 || width < 1 || height < 1 || (format != MAPPED_FLOAT32 && format != MAPPED_UINT16)) return false;
+	if (tileSize < 0) tileSize = 0;
+
+	size_t sampleSize = format == MAPPED_UINT16 ? sizeof(uint16_t) : sizeof(float);
+	MappedFile M;
+	if (!openMapped(&M, path, MAPPED_NOISE_HEADER_SIZE + sampleCount(width, height, tileSize)*sampleSize)) return false;
+
+	MappedNoiseHeader* header = (MappedNoiseHeader*)M.base;
+	memset(header, 0, sizeof(MappedNoiseHeader));
+	header->magic = MAPPED_NOISE_MAGIC;
+	header->version = MAPPED_NOISE_VERSION;
+	header->headerSize = MAPPED_NOISE_HEADER_SIZE;
+	header->format = format;
+	header->width = width;
+	header->height = height;
+	header->tileSize = tileSize;
+	header->params = *params;
+	GetNoiseRangeBound(params, &header->rangeMin, &header->rangeMax);
+
+	SphereTable T;
+	InitSphereTable(&T, width, height, params->seed);
+	Settings S;
+	initSIMD(&S, params->frequency, params->lacunarity, params->offset, params->gain, params->octaves);
+
+	int band = tileSize > 0 ? tileSize : GetSchedulerGrain();
+	int chunks = ChunkCount(height, band);
+	MappedContext C = { &M, &T, &S, fractalFunction, noiseFunction, format, tileSize,
+		header->rangeMin, 65535.0f / (header->rangeMax - header->rangeMin), new float[chunks], new float[chunks] };
+	ParallelFor(height, band, mappedChunk, &C);
+	ReduceChunkMinMax(C.chunkMin, C.chunkMax, chunks, outMin, outMax);
+	delete[] C.chunkMin;
+	delete[] C.chunkMax;
+	FreeSphereTable(&T);
+
+	header->min = *outMin;
+	header->max = *outMax;
+	header->complete = 1;
+	return closeMapped(&M);
+}
+
+const MappedNoiseHeader* MapNoiseFile(const char* path)
+{
+	void* p;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return 0;
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	size = (size_t)fileSize.QuadPart;
+	HANDLE mapping = size >= sizeof(MappedNoiseHeader) ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	p = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (mapping) CloseHandle(mapping);
+	CloseHandle(file);
+	if (!p) return 0;
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0) return 0;
+	struct stat st;
+	if (fstat(file, &st) != 0 || (size_t)st.st_size < sizeof(MappedNoiseHeader))
+	{
+		close(file);
+		return 0;
+	}
+	size = (size_t)st.st_size;
+	p = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+	close(file);
+	if (p == MAP_FAILED) return 0;
+#endif
+	const MappedNoiseHeader* header = (const MappedNoiseHeader*)p;
+	size_t sampleSize = header->format == MAPPED_UINT16 ? sizeof(uint16_t) : sizeof(float);
+	bool valid = header->magic == MAPPED_NOISE_MAGIC && header->version == MAPPED_NOISE_VERSION && header->complete
+		&& header->width > 0 && header->height > 0
+		&& header->headerSize + sampleCount(header->width, header->height, header->tileSize)*sampleSize <= size;
+	if (!valid)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(p);
+#else
+		munmap(p, size);
+#endif
+		return 0;
+	}
+#ifndef _WIN32
+	std::lock_guard<std::mutex> guard(mappedLock);
+	mappedSizes[p] = size;
+#endif
+	return header;
+}
+
+void UnmapNoiseFile(const MappedNoiseHeader* header)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(header);
+#else
+	size_t size;
+	{
+		std::lock_guard<std::mutex> guard(mappedLock);
+		auto it = mappedSizes.find(header);
+		if (it == mappedSizes.end()) return;
+		size = it->second;
+		mappedSizes.erase(it);
+	}
+	munmap((void*)header, size);
+#endif
+}
@@ -0,0 +1,174 @@
+#include "headers\MipPyramid.h"
+#include "headers\TileScheduler.h"
+
+//Levels halve (rounding down) until both sides are 1
+int GetMipLevelCount(int width, int height)
+{
+	int levels = 1;
+	while (width > 1 || height > 1)
+	{
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+		levels++;
+	}
+	return levels;
+}
+
+//Offset in floats of a level inside the pyramid buffer, levels are packed
+//one after another starting with the full resolution one
+size_t GetMipLevelOffset(int width, int height, int level, int* levelWidth, int* levelHeight)
+{
+	size_t offset = 0;
+	for (int i = 0; i < level; i++)
+	{
+		offset += (size_t)width*height;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	if (levelWidth) *levelWidth = width;
+	if (levelHeight) *levelHeight = height;
+	return offset;
+}
+
+//2x2 box filter of one row of dst from src, a side that is already 1 is only filtered along the other one
+static void boxFilterRowSIMD(float* __restrict out, int width, int y, const float* __restrict src, int srcWidth, int srcHeight)
+{
+	SIMD quarter = SetOne(0.25f);
+	const float* row0 = src + (size_t)(2 * y < srcHeight ? 2 * y : srcHeight - 1)*srcWidth;
+	const float* row1 = src + (size_t)(2 * y + 1 < srcHeight ? 2 * y + 1 : srcHeight - 1)*srcWidth;
+	int x = 0;
+	if (srcWidth > 1)
+	{
+		for (; x + VECTOR_SIZE <= width; x = x + VECTOR_SIZE)
+		{
+			SIMD a = Add(LoadU(row0 + 2 * x), LoadU(row1 + 2 * x));
+			SIMD b = Add(LoadU(row0 + 2 * x + VECTOR_SIZE), LoadU(row1 + 2 * x + VECTOR_SIZE));
+			StoreU(out + x, Mul(HAddPairs(a, b), quarter));
+		}
+	}
+	//same summation order as the SIMD part
+	for (; x < width; x++)
+	{
+		int x0 = 2 * x < srcWidth ? 2 * x : srcWidth - 1;
+		int x1 = 2 * x + 1 < srcWidth ? 2 * x + 1 : srcWidth - 1;
+		out[x] = ((row0[x0] + row1[x0]) + (row0[x1] + row1[x1]))*0.25f;
+	}
+}
+
+//Called once row y of a level is complete, filters every row of the coarser
+//levels up to lastLevel that now has all of its source rows
+static void boxCascadeSIMD(float* pyramid, int width, int height, int lastLevel, int level, int y)
+{
+	while (level < lastLevel)
+	{
+		int srcWidth, srcHeight, w, h;
+		float* src = pyramid + GetMipLevelOffset(width, height, level, &srcWidth, &srcHeight);
+		float* dst = pyramid + GetMipLevelOffset(width, height, level + 1, &w, &h);
+		int dy = y / 2;
+		int last = 2 * dy + 1 < srcHeight ? 2 * dy + 1 : srcHeight - 1;
+		if (dy >= h || last != y) return;
+		boxFilterRowSIMD(dst + (size_t)dy*w, w, dy, src, srcWidth, srcHeight);
+		level++;
+		y = dy;
+	}
+}
+
+struct MipContext
+{
+	float* result;
+	const SphereTable* T;
+	const Settings* S;
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	int cascadeLevel;
+	float* chunkMin;
+	float* chunkMax;
+};
+
+static void mipChunk(void* context, int begin, int end, int chunk)
+{
+	MipContext* C = (MipContext*)context;
+	Settings S = *C->S;
+	int width = C->T->width;
+	int height = C->T->height;
+	SIMD min = SetOne(999);
+	SIMD max = SetOne(-999);
+	for (int y = begin; y < end; y = y + 1)
+	{
+		FillSphereRowSIMD(C->result + (size_t)y*width, C->T, y, 0, width, &S, C->fractalFunction, C->noiseFunction, &min, &max);
+		boxCascadeSIMD(C->result, width, height, C->cascadeLevel, 0, y);
+	}
+	ReduceMinMax(&min, &max, &C->chunkMin[chunk], &C->chunkMax[chunk]);
+}
+
+//Generates the whole mip chain of a sphere map into one contiguous buffer,
+//use GetMipLevelOffset to find the levels. Free with CleanUpNoiseSIMD.
+float* GetSphereSurfaceMipsSIMD(const NoiseParams* params, int width, int height, int mipMode, int* outLevels, float* __restrict outMin, float* __restrict outMax)
+{
+	if (width < 1 || height < 1) return 0;
+	if (mipMode != MIP_BOX && mipMode != MIP_DIRECT) return 0;
+
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	if (!SelectFractalSIMD(params->fractalType, params->octaves, &fractalFunction)) return 0;
+	if (!SelectNoiseSIMD(params->noiseType, &noiseFunction, params->quality)) return 0;
+
+	int levels = GetMipLevelCount(width, height);
+	size_t total = GetMipLevelOffset(width, height, levels, 0, 0);
+	float* result = (float*)_aligned_malloc(total*sizeof(float), MEMORY_ALIGNMENT);
+
+	if (mipMode == MIP_BOX)
+	{
+		//filter the coarser levels while the rows they come from are still in cache.
+		//Bands are a power of two rows, so a row of level l <= log2(band) only
+		//depends on rows of its own band, the few levels above that are filtered afterwards.
+		SphereTable T;
+		InitSphereTable(&T, width, height, params->seed);
+		Settings S;
+		initSIMD(&S, params->frequency, params->lacunarity, params->offset, params->gain, params->octaves);
+
+		int grain = 1;
+		int cascadeLevel = 0;
+		while (grain * 2 <= GetSchedulerGrain())
+		{
+			grain = grain * 2;
+			cascadeLevel++;
+		}
+		if (cascadeLevel > levels - 1) cascadeLevel = levels - 1;
+		int chunks = ChunkCount(height, grain);
+		MipContext C = { result, &T, &S, fractalFunction, noiseFunction, cascadeLevel, new float[chunks], new float[chunks] };
+		ParallelFor(height, grain, mipChunk, &C);
+		ReduceChunkMinMax(C.chunkMin, C.chunkMax, chunks, outMin, outMax);
+		delete[] C.chunkMin;
+		delete[] C.chunkMax;
+		FreeSphereTable(&T);
+
+		for (int level = cascadeLevel + 1; level < levels; level++)
+		{
+			int srcWidth, srcHeight, w, h;
+			float* src = result + GetMipLevelOffset(width, height, level - 1, &srcWidth, &srcHeight);
+			float* dst = result + GetMipLevelOffset(width, height, level, &w, &h);
+			for (int y = 0; y < h; y++) boxFilterRowSIMD(dst + (size_t)y*w, w, y, src, srcWidth, srcHeight);
+		}
+	}
+	else
+	{
+		NoiseParams P = *params;
+		*outMin = 999;
+		*outMax = -999;
+		for (int level = 0; level < levels; level++)
+		{
+			int w, h;
+			float min, max;
+			float* dst = result + GetMipLevelOffset(width, height, level, &w, &h);
+			//each halving drops the octave finer than the new pixel spacing
+			if (level > 0 && P.octaves > 1) P.octaves--;
+			FillSphereSurfaceTileSIMD(dst, &P, w, h, 0, 0, w, h, &min, &max);
+			*outMin = fminf(*outMin, min);
+			*outMax = fmaxf(*outMax, max);
+		}
+	}
+
+	if (outLevels) *outLevels = levels;
+	return result;
+}
@@ -0,0 +1,147 @@
+#include "headers\MultiChannel.h"
+#include "headers\TileScheduler.h"
+#include "headers\NoiseStats.h"
+
+struct ChannelContext
+{
+	float* result;
+	const SphereTable* T; //unseeded, every channel adds its own origin
+	Settings* S; //one template per channel
+	ISIMDFractal3d fractalFunction[MAX_CHANNELS];
+	ISIMDNoise3d noiseFunction[MAX_CHANNELS];
+	float origin[MAX_CHANNELS][3];
+	int channels;
+	int layout;
+	float* chunkMin; //channels values per chunk
+	float* chunkMax;
+};
+
+static void channelChunk(void* context, int begin, int end, int chunk)
+{
+	ChannelContext* C = (ChannelContext*)context;
+	int channels = C->channels;
+	int width = C->T->width;
+	size_t plane = (size_t)width*C->T->height;
+
+	//SIMD members need alignment the stack doesn't promise for arrays this size
+	Settings* S = (Settings*)_aligned_malloc(channels * sizeof(Settings), MEMORY_ALIGNMENT);
+	uSIMD* r = (uSIMD*)_aligned_malloc(channels * sizeof(uSIMD), MEMORY_ALIGNMENT);
+	SIMD* min = (SIMD*)_aligned_malloc(2 * channels * sizeof(SIMD), MEMORY_ALIGNMENT);
+	SIMD* max = min + channels;
+	for (int c = 0; c < channels; c++)
+	{
+		S[c] = C->S[c];
+		min[c] = SetOne(999);
+		max[c] = SetOne(-999);
+	}
+
+	Settings base;
+	for (int y = begin; y < end; y++)
+	{
+		float sinPhi = SphereRowSIMD(&base, C->T, y);
+		for (int x = 0; x < width; x = x + VECTOR_SIZE)
+		{
+			//the coordinates are computed once and shared by every channel
+			SphereVectorSIMD(&base, C->T, x, width, sinPhi);
+			int count = width - x < VECTOR_SIZE ? width - x : VECTOR_SIZE;
+			for (int c = 0; c < channels; c++)
+			{
+				S[c].x.m = Add(base.x.m, SetOne(C->origin[c][0]));
+				S[c].y.m = Add(base.y.m, SetOne(C->origin[c][1]));
+				S[c].z.m = Add(base.z.m, SetOne(C->origin[c][2]));
+				C->fractalFunction[c](&r[c].m, &S[c], C->noiseFunction[c]);
+				min[c] = Min(min[c], r[c].m);
+				max[c] = Max(max[c], r[c].m);
+				if (C->layout == CHANNELS_PLANAR) StorePartial(C->result + c*plane + (size_t)y*width + x, r[c].m, count);
+			}
+			if (C->layout == CHANNELS_INTERLEAVED)
+			{
+				float* out = C->result + ((size_t)y*width + x)*channels;
+				for (int j = 0; j < count; j++)
+				{
+					for (int c = 0; c < channels; c++) *out++ = r[c].a[j];
+				}
+			}
+		}
+	}
+	for (int c = 0; c < channels; c++)
+	{
+		ReduceMinMax(&min[c], &max[c], &C->chunkMin[chunk*channels + c], &C->chunkMax[chunk*channels + c]);
+	}
+	_aligned_free(S);
+	_aligned_free(r);
+	_aligned_free(min);
+}
+
+//Evaluates channels independent sphere maps over the same coordinates in one pass,
+//params holds one parameter set per channel
+bool FillSphereSurfaceChannelsSIMD(float* result, const NoiseParams* params, int channels, int width, int height, int layout, float* outMin, float* outMax)
+{
+	STATS_BEGIN(setup);
+	if (channels < 1 || channels > MAX_CHANNELS || width < 1 || height < 1) return false;
+	if (layout != CHANNELS_INTERLEAVED && layout != CHANNELS_PLANAR) return false;
+
+	ChannelContext C;
+	for (int c = 0; c < channels; c++)
+	{
+		if (!SelectFractalSIMD(params[c].fractalType, params[c].octaves, &C.fractalFunction[c])) return false;
+		if (!SelectNoiseSIMD(params[c].noiseType, &C.noiseFunction[c], params[c].quality)) return false;
+		SeedOffset(params[c].seed, &C.origin[c][0], &C.origin[c][1], &C.origin[c][2]);
+	}
+
+	SphereTable T;
+	InitSphereTable(&T, width, height);
+	Settings* S = (Settings*)_aligned_malloc(channels * sizeof(Settings), MEMORY_ALIGNMENT);
+	for (int c = 0; c < channels; c++)
+	{
+		initSIMD(&S[c], params[c].frequency, params[c].lacunarity, params[c].offset, params[c].gain, params[c].octaves);
+	}
+
+	int grain = GetSchedulerGrain();
+	int chunks = ChunkCount(height, grain);
+	C.result = result;
+	C.T = &T;
+	C.S = S;
+	C.channels = channels;
+	C.layout = layout;
+	C.chunkMin = new float[chunks*channels];
+	C.chunkMax = new float[chunks*channels];
+	STATS_END(setup, PHASE_SETUP);
+
+	STATS_BEGIN(kernel);
+	ParallelFor(height, grain, channelChunk, &C);
+	STATS_END(kernel, PHASE_KERNEL);
+
+	STATS_BEGIN(reduction);
+	for (int c = 0; c < channels; c++)
+	{
+		STATS_COUNT((uint64_t)width*height, params[c].fractalType == PLAIN ? 1 : params[c].octaves);
+		outMin[c] = 999;
+		outMax[c] = -999;
+		for (int i = 0; i < chunks; i++)
+		{
+			outMin[c] = fminf(outMin[c], C.chunkMin[i*channels + c]);
+			outMax[c] = fmaxf(outMax[c], C.chunkMax[i*channels + c]);
+		}
+	}
+	delete[] C.chunkMin;
+	delete[] C.chunkMax;
+	_aligned_free(S);
+	FreeSphereTable(&T);
+	STATS_END(reduction, PHASE_REDUCTION);
+	return true;
+}
+
+//Allocating version, free the result with CleanUpNoiseSIMD
+float* GetSphereSurfaceChannelsSIMD(const NoiseParams* params, int channels, int width, int height, int layout, float* outMin, float* outMax)
+{
+	STATS_BEGIN(allocation);
+	float* result = (float*)_aligned_malloc((size_t)width*height*channels*sizeof(float), MEMORY_ALIGNMENT);
+	STATS_END(allocation, PHASE_ALLOCATION);
+	if (!FillSphereSurfaceChannelsSIMD(result, params, channels, width, height, layout, outMin, outMax))
+	{
+		_aligned_free(result);
+		return 0;
+	}
+	return result;
+}
@@ -0,0 +1,192 @@
+#include "headers\NoiseCache.h"
+#include <string.h>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+
+//Tiles are shared between callers, every lookup holds a reference until
+//ReleaseCachedNoise and only unreferenced tiles are evicted
+struct CacheEntry
+{
+	NoiseCacheKey key;
+	uint64_t hash;
+	float* data;
+	size_t bytes;
+	float min;
+	float max;
+	int references;
+	bool ready;  //false while the first requester is still generating it
+	bool failed;
+	std::list<CacheEntry*>::iterator lru;
+};
+
+static std::mutex cacheLock;
+static std::condition_variable cacheReady;
+static std::unordered_multimap<uint64_t, CacheEntry*> cacheEntries;
+static std::unordered_map<const float*, CacheEntry*> cacheByData;
+static std::list<CacheEntry*> cacheLRU; //most recently used first
+static size_t cacheBudget = 256 * 1024 * 1024;
+static size_t cacheBytes = 0;
+
+
+//FNV-1a over the key, keys are always zero filled so padding can't differ
+uint64_t HashNoiseCacheKey(const NoiseCacheKey* key)
+{
+	const unsigned char* p = (const unsigned char*)key;
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < sizeof(NoiseCacheKey); i++)
+	{
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+static void removeEntry(CacheEntry* e)
+{
+	auto range = cacheEntries.equal_range(e->hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second == e)
+		{
+			cacheEntries.erase(it);
+			break;
+		}
+	}
+	if (e->data) cacheByData.erase(e->data);
+	cacheLRU.erase(e->lru);
+	cacheBytes -= e->bytes;
+	_aligned_free(e->data);
+	delete e;
+}
+
+//Must hold cacheLock
+static void evict()
+{
+	auto it = cacheLRU.end();
+	while (cacheBytes > cacheBudget && it != cacheLRU.begin())
+	{
+		--it;
+		CacheEntry* e = *it;
+		if (e->references != 0 || !e->ready) continue;
+		auto next = it;
+		++next;
+		removeEntry(e);
+		it = next;
+	}
+}
+
+void SetNoiseCacheBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(cacheLock);
+	cacheBudget = bytes;
+	evict();
+}
+
+//Drops every tile that is not referenced
+void ClearNoiseCache()
+{
+	std::lock_guard<std::mutex> lock(cacheLock);
+	size_t budget = cacheBudget;
+	cacheBudget = 0;
+	evict();
+	cacheBudget = budget;
+}
+
+//Returns the tile from the cache or generates it. When several threads ask
+//for the same missing tile only the first generates it, the rest wait for it.
+//The result must be handed back with ReleaseCachedNoise, not CleanUpNoiseSIMD.
+const float* GetSphereSurfaceTileCached(const NoiseParams* params, int width, int height, int x0, int y0, int tileWidth, int tileHeight, float* outMin, float* outMax)
+{
+	NoiseCacheKey key;
+	memset(&key, 0, sizeof(key));
+	key.generator = SPHERE_SURFACE_SIMD;
+	key.width = width;
+	key.height = height;
+	key.x0 = x0;
+	key.y0 = y0;
+	key.tileWidth = tileWidth;
+	key.tileHeight = tileHeight;
+	key.params = *params;
+	uint64_t hash = HashNoiseCacheKey(&key);
+
+	std::unique_lock<std::mutex> lock(cacheLock);
+	CacheEntry* e = 0;
+	auto range = cacheEntries.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (memcmp(&it->second->key, &key, sizeof(key)) == 0)
+		{
+			e = it->second;
+			break;
+		}
+	}
+
+	if (e)
+	{
+		e->references++;
+		cacheReady.wait(lock, [e] { return e->ready; });
+		if (e->failed)
+		{
+			if (--e->references == 0) removeEntry(e);
+			return 0;
+		}
+		cacheLRU.splice(cacheLRU.begin(), cacheLRU, e->lru);
+		*outMin = e->min;
+		*outMax = e->max;
+		return e->data;
+	}
+
+	e = new CacheEntry;
+	e->key = key;
+	e->hash = hash;
+	e->data = 0;
+	e->bytes = 0;
+	e->references = 1;
+	e->ready = false;
+	e->failed = false;
+	cacheLRU.push_front(e);
+	e->lru = cacheLRU.begin();
+	cacheEntries.insert(std::make_pair(hash, e));
+	lock.unlock();
+
+	//generate outside of the lock so other tiles can be looked up meanwhile
+	size_t bytes = (size_t)tileWidth*tileHeight*sizeof(float);
+	float* data = (float*)_aligned_malloc(bytes, MEMORY_ALIGNMENT);
+	float min, max;
+	bool ok = data && FillSphereSurfaceTileSIMD(data, params, width, height, x0, y0, tileWidth, tileHeight, &min, &max);
+
+	lock.lock();
+	e->ready = true;
+	if (!ok)
+	{
+		_aligned_free(data);
+		e->failed = true;
+		cacheReady.notify_all();
+		if (--e->references == 0) removeEntry(e);
+		return 0;
+	}
+	e->data = data;
+	e->bytes = bytes;
+	e->min = min;
+	e->max = max;
+	cacheByData[data] = e;
+	cacheBytes += bytes;
+	cacheReady.notify_all();
+	evict();
+
+	*outMin = min;
+	*outMax = max;
+	return data;
+}
+
+void ReleaseCachedNoise(const float* resultArray)
+{
+	std::lock_guard<std::mutex> lock(cacheLock);
+	auto it = cacheByData.find(resultArray);
+	//ignore a tile released more often than it was handed out
+	if (it == cacheByData.end() || it->second->references == 0) return;
+	it->second->references--;
+	evict();
+}
@@ -0,0 +1,360 @@
+#include "headers\NoiseGraph.h"
+#include "headers\TileScheduler.h"
+#include <vector>
+
+struct GraphNode
+{
+	int op;
+	int inputs[3];
+	float params[4];
+	NoiseParams noise;
+	std::vector<float> curve;
+};
+
+//One compiled step, inputs and result are slot numbers
+struct GraphInstruction
+{
+	int op;
+	int dst;
+	int a;
+	int b;
+	int c;
+	SIMD p0;
+	SIMD p1;
+	int smooth; //select blends over the falloff band
+	ISIMDFractal3d fractalFunction;
+	ISIMDNoise3d noiseFunction;
+	Settings S;
+	float seedX;
+	float seedY;
+	float seedZ;
+	int curve; //index of the first point in curvePoints
+	int curveCount;
+};
+
+struct NoiseGraph
+{
+	std::vector<GraphNode> nodes;
+	GraphInstruction* program; //holds SIMD members so it is allocated aligned
+	int programSize;
+	std::vector<float> curvePoints;
+	int output;
+};
+
+
+NoiseGraph* CreateNoiseGraph()
+{
+	NoiseGraph* graph = new NoiseGraph;
+	graph->output = -1;
+	graph->program = 0;
+	graph->programSize = 0;
+	return graph;
+}
+
+void CleanUpNoiseGraph(NoiseGraph* graph)
+{
+	if (!graph) return;
+	_aligned_free(graph->program);
+	delete graph;
+}
+
+static bool validNode(const NoiseGraph* graph, int id)
+{
+	return id >= 0 && id < (int)graph->nodes.size();
+}
+
+static int addNode(NoiseGraph* graph, int op, int a, int b, int c)
+{
+	GraphNode node = {};
+	node.op = op;
+	node.inputs[0] = a;
+	node.inputs[1] = b;
+	node.inputs[2] = c;
+	for (int i = 0; i < 4; i++) node.params[i] = 0;
+	graph->nodes.push_back(node);
+	return (int)graph->nodes.size() - 1;
+}
+
+int NoiseGraphSource(NoiseGraph* graph, const NoiseParams* params)
+{
+	ISIMDFractal3d fractalFunction;
+	if (!SelectFractalSIMD(params->fractalType, params->octaves, &fractalFunction)) return -1;
+	if (params->noiseType != PERLIN && params->noiseType != SIMPLEX) return -1;
+	if (params->quality < QUALITY_REFERENCE || params->quality > QUALITY_FASTEST) return -1;
+	int id = addNode(graph, GRAPH_SOURCE, -1, -1, -1);
+	graph->nodes[id].noise = *params;
+	return id;
+}
+
+int NoiseGraphConstant(NoiseGraph* graph, float value)
+{
+	int id = addNode(graph, GRAPH_CONSTANT, -1, -1, -1);
+	graph->nodes[id].params[0] = value;
+	return id;
+}
+
+int NoiseGraphBinary(NoiseGraph* graph, int op, int a, int b)
+{
+	if (op != GRAPH_ADD && op != GRAPH_MULTIPLY && op != GRAPH_MIN && op != GRAPH_MAX) return -1;
+	if (!validNode(graph, a) || !validNode(graph, b)) return -1;
+	return addNode(graph, op, a, b, -1);
+}
+
+int NoiseGraphSelect(NoiseGraph* graph, int control, int a, int b, float threshold, float falloff)
+{
+	if (!validNode(graph, control) || !validNode(graph, a) || !validNode(graph, b) || falloff < 0) return -1;
+	int id = addNode(graph, GRAPH_SELECT, a, b, control);
+	graph->nodes[id].params[0] = threshold;
+	graph->nodes[id].params[1] = falloff;
+	return id;
+}
+
+int NoiseGraphClamp(NoiseGraph* graph, int source, float low, float high)
+{
+	if (!validNode(graph, source) || low > high) return -1;
+	int id = addNode(graph, GRAPH_CLAMP, source, -1, -1);
+	graph->nodes[id].params[0] = low;
+	graph->nodes[id].params[1] = high;
+	return id;
+}
+
+int NoiseGraphScaleBias(NoiseGraph* graph, int source, float scale, float bias)
+{
+	if (!validNode(graph, source)) return -1;
+	int id = addNode(graph, GRAPH_SCALE_BIAS, source, -1, -1);
+	graph->nodes[id].params[0] = scale;
+	graph->nodes[id].params[1] = bias;
+	return id;
+}
+
+int NoiseGraphCurve(NoiseGraph* graph, int source, const float* points, int count)
+{
+	if (!validNode(graph, source) || count < 1) return -1;
+	for (int i = 1; i < count; i++)
+	{
+		if (points[2 * i] <= points[2 * i - 2]) return -1;
+	}
+	int id = addNode(graph, GRAPH_CURVE, source, -1, -1);
+	graph->nodes[id].curve.assign(points, points + 2 * count);
+	return id;
+}
+
+
+//Node ids are already in dependency order, so compiling is keeping the nodes
+//output needs and handing out slots, reusing a slot once its last reader ran
+bool CompileNoiseGraph(NoiseGraph* graph, int output)
+{
+	if (!validNode(graph, output)) return false;
+	int count = (int)graph->nodes.size();
+
+	std::vector<bool> used(count, false);
+	std::vector<int> lastUse(count, -1);
+	used[output] = true;
+	for (int id = output; id >= 0; id--)
+	{
+		if (!used[id]) continue;
+		for (int i = 0; i < 3; i++)
+		{
+			int in = graph->nodes[id].inputs[i];
+			if (in < 0) continue;
+			used[in] = true;
+			if (lastUse[in] < id) lastUse[in] = id;
+		}
+	}
+
+	_aligned_free(graph->program);
+	graph->program = (GraphInstruction*)_aligned_malloc((output + 1)*sizeof(GraphInstruction), MEMORY_ALIGNMENT);
+	graph->programSize = 0;
+	graph->output = -1;
+	graph->curvePoints.clear();
+	std::vector<int> slotOf(count, -1);
+	std::vector<int> freeSlots;
+	for (int s = GRAPH_MAX_SLOTS - 1; s >= 0; s--) freeSlots.push_back(s);
+
+	for (int id = 0; id <= output; id++)
+	{
+		if (!used[id]) continue;
+		const GraphNode& node = graph->nodes[id];
+		GraphInstruction I;
+		I.op = node.op;
+		I.a = node.inputs[0] >= 0 ? slotOf[node.inputs[0]] : -1;
+		I.b = node.inputs[1] >= 0 ? slotOf[node.inputs[1]] : -1;
+		I.c = node.inputs[2] >= 0 ? slotOf[node.inputs[2]] : -1;
+		I.p0 = SetOne(node.params[0]);
+		I.p1 = SetOne(node.params[1]);
+
+		switch (node.op)
+		{
+		case GRAPH_SOURCE:
+			SelectFractalSIMD(node.noise.fractalType, node.noise.octaves, &I.fractalFunction);
+			SelectNoiseSIMD(node.noise.noiseType, &I.noiseFunction, node.noise.quality);
+			initSIMD(&I.S, node.noise.frequency, node.noise.lacunarity, node.noise.offset, node.noise.gain, node.noise.octaves);
+			SeedOffset(node.noise.seed, &I.seedX, &I.seedY, &I.seedZ);
+			break;
+		case GRAPH_SELECT:
+			//falloff becomes the start of the blend and one over its width
+			if (node.params[1] > 0)
+			{
+				I.p0 = SetOne(node.params[0] - node.params[1]);
+				I.p1 = SetOne(0.5f / node.params[1]);
+			}
+			break;
+		case GRAPH_CURVE:
+			I.curve = (int)graph->curvePoints.size();
+			I.curveCount = (int)node.curve.size() / 2;
+			graph->curvePoints.insert(graph->curvePoints.end(), node.curve.begin(), node.curve.end());
+			break;
+		}
+		I.smooth = node.op == GRAPH_SELECT && node.params[1] > 0;
+
+		//inputs whose last reader is this node give their slot back first,
+		//so the result may overwrite one of them
+		for (int i = 0; i < 3; i++)
+		{
+			int in = node.inputs[i];
+			if (in >= 0 && lastUse[in] == id && slotOf[in] >= 0)
+			{
+				freeSlots.push_back(slotOf[in]);
+				slotOf[in] = -1;
+			}
+		}
+		if (freeSlots.empty()) return false;
+		I.dst = freeSlots.back();
+		freeSlots.pop_back();
+		slotOf[id] = I.dst;
+		graph->program[graph->programSize++] = I;
+	}
+
+	graph->output = output;
+	return true;
+}
+
+
+//Runs the whole program for one coordinate vector
+static SIMD runGraphSIMD(const NoiseGraph* graph, const Settings* coords)
+{
+	SIMD slots[GRAPH_MAX_SLOTS];
+	const GraphInstruction* program = graph->program;
+	int count = graph->programSize;
+	for (int n = 0; n < count; n++)
+	{
+		const GraphInstruction* I = &program[n];
+		SIMD r;
+		switch (I->op)
+		{
+		case GRAPH_SOURCE:
+		{
+			Settings S = I->S;
+			S.x.m = Add(coords->x.m, SetOne(I->seedX));
+			S.y.m = Add(coords->y.m, SetOne(I->seedY));
+			S.z.m = Add(coords->z.m, SetOne(I->seedZ));
+			I->fractalFunction(&r, &S, I->noiseFunction);
+			break;
+		}
+		case GRAPH_CONSTANT: r = I->p0; break;
+		case GRAPH_ADD: r = Add(slots[I->a], slots[I->b]); break;
+		case GRAPH_MULTIPLY: r = Mul(slots[I->a], slots[I->b]); break;
+		case GRAPH_MIN: r = Min(slots[I->a], slots[I->b]); break;
+		case GRAPH_MAX: r = Max(slots[I->a], slots[I->b]); break;
+		case GRAPH_CLAMP: r = Min(Max(slots[I->a], I->p0), I->p1); break;
+		case GRAPH_SCALE_BIAS: r = Add(Mul(slots[I->a], I->p0), I->p1); break;
+		case GRAPH_SELECT:
+		{
+			SIMD a = slots[I->a];
+			SIMD b = slots[I->b];
+			if (I->smooth)
+			{
+				//s-curve blend from a to b across the falloff band
+				SIMD t = Mul(Sub(slots[I->c], I->p0), I->p1);
+				t = Min(Max(t, zero), onef);
+				t = Mul(Mul(t, t), Sub(SetOne(3.0f), Add(t, t)));
+				r = Add(a, Mul(t, Sub(b, a)));
+			}
+			else
+			{
+				SIMD cond = LessThan(slots[I->c], I->p0);
+				r = Or(And(cond, a), AndNot(cond, b));
+			}
+			break;
+		}
+		case GRAPH_CURVE:
+		{
+			const float* p = graph->curvePoints.data() + I->curve;
+			SIMD x = slots[I->a];
+			r = SetOne(p[1]);
+			for (int i = 0; i + 1 < I->curveCount; i++)
+			{
+				SIMD x0 = SetOne(p[2 * i]);
+				SIMD y0 = SetOne(p[2 * i + 1]);
+				SIMD t = Mul(Sub(x, x0), SetOne(1.0f / (p[2 * i + 2] - p[2 * i])));
+				t = Min(Max(t, zero), onef);
+				SIMD v = Add(y0, Mul(t, Sub(SetOne(p[2 * i + 3]), y0)));
+				SIMD cond = GreaterThanOrEq(x, x0);
+				r = Or(And(cond, v), AndNot(cond, r));
+			}
+			break;
+		}
+		default: r = zero;
+		}
+		slots[I->dst] = r;
+	}
+	return slots[program[count - 1].dst];
+}
+
+struct GraphContext
+{
+	const NoiseGraph* graph;
+	const SphereTable* T;
+	float* result;
+	float* chunkMin;
+	float* chunkMax;
+};
+
+static void graphChunk(void* context, int begin, int end, int chunk)
+{
+	GraphContext* C = (GraphContext*)context;
+	int width = C->T->width;
+	Settings S;
+	SIMD min = SetOne(999);
+	SIMD max = SetOne(-999);
+	for (int y = begin; y < end; y = y + 1)
+	{
+		float sinPhi = SphereRowSIMD(&S, C->T, y);
+		for (int x = 0; x < width; x = x + VECTOR_SIZE)
+		{
+			SphereVectorSIMD(&S, C->T, x, width, sinPhi);
+			SIMD r = runGraphSIMD(C->graph, &S);
+			min = Min(min, r);
+			max = Max(max, r);
+			int count = width - x < VECTOR_SIZE ? width - x : VECTOR_SIZE;
+			StorePartial(C->result + (size_t)y*width + x, r, count);
+		}
+	}
+	ReduceMinMax(&min, &max, &C->chunkMin[chunk], &C->chunkMax[chunk]);
+}
+
+//Evaluates a compiled graph over a sphere map, one SIMD vector at a time so
+//no intermediate ever needs a full size buffer. Free with CleanUpNoiseSIMD.
+float* GetSphereSurfaceGraphSIMD(const NoiseGraph* graph, int width, int height, float* __restrict outMin, float* __restrict outMax)
+{
+	if (!graph || graph->output < 0 || graph->programSize == 0 || width < 1 || height < 1) return 0;
+
+	Settings S;
+	initSIMD(&S, 1, 1, 0, 0, 1);
+	initSIMDSimplex();
+
+	float* result = (float*)_aligned_malloc((size_t)width*height*sizeof(float), MEMORY_ALIGNMENT);
+	SphereTable T;
+	InitSphereTable(&T, width, height);
+
+	int grain = GetSchedulerGrain();
+	int chunks = ChunkCount(height, grain);
+	GraphContext C = { graph, &T, result, new float[chunks], new float[chunks] };
+	ParallelFor(height, grain, graphChunk, &C);
+
+	ReduceChunkMinMax(C.chunkMin, C.chunkMax, chunks, outMin, outMax);
+	delete[] C.chunkMin;
+	delete[] C.chunkMax;
+	FreeSphereTable(&T);
+	return result;
+}
@@ -0,0 +1,179 @@
+#include "headers\NoiseJobs.h"
+#include "headers\TileScheduler.h"
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+struct NoiseJob
+{
+	Settings S; //template copied by every band
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	SphereTable T;
+	int width;
+	int height;
+	int bands;
+	float* result;
+	float* bandMin; //partial min/max of every band, reduced when the job ends
+	float* bandMax;
+	bool* bandDone;
+	NoiseJobCallback callback;
+	void* userData;
+	std::atomic<int> rowsDone;
+	std::atomic<bool> cancelled;
+	std::atomic<int> references; //the caller and the scheduler batch
+	int status;
+	float min;
+	float max;
+	std::mutex lock;
+	std::condition_variable finished;
+};
+
+static void releaseJob(NoiseJob* job)
+{
+	if (--job->references != 0) return;
+	_aligned_free(job->result);
+	FreeSphereTable(&job->T);
+	delete[] job->bandMin;
+	delete[] job->bandMax;
+	delete[] job->bandDone;
+	job->~NoiseJob();
+	_aligned_free(job);
+}
+
+//Runs on the thread that finished the last band, a worker or a waiter
+static void finishJob(void* context)
+{
+	NoiseJob* job = (NoiseJob*)context;
+	int status = JOB_DONE;
+	for (int b = 0; b < job->bands; b++)
+	{
+		if (!job->bandDone[b]) status = JOB_CANCELLED;
+	}
+	if (status == JOB_DONE) ReduceChunkMinMax(job->bandMin, job->bandMax, job->bands, &job->min, &job->max);
+	//waiters only return once the callback is done with userData
+	if (job->callback) job->callback(job, status, job->userData);
+	{
+		std::lock_guard<std::mutex> guard(job->lock);
+		job->status = status;
+	}
+	job->finished.notify_all();
+	releaseJob(job);
+}
+
+static void runBand(void* context, int begin, int end, int band)
+{
+	NoiseJob* job = (NoiseJob*)context;
+	job->bandDone[band] = false;
+	if (job->cancelled) return;
+	Settings S = job->S;
+	SIMD min = SetOne(999);
+	SIMD max = SetOne(-999);
+	int y = begin;
+	for (; y < end && !job->cancelled; y++)
+	{
+		FillSphereRowSIMD(job->result + (size_t)y*job->width, &job->T, y, 0, job->width, &S, job->fractalFunction, job->noiseFunction, &min, &max);
+		job->rowsDone++;
+	}
+	ReduceMinMax(&min, &max, &job->bandMin[band], &job->bandMax[band]);
+	job->bandDone[band] = y == end;
+}
+
+
+//Queues a sphere map on the scheduler and returns at once. The handle stays
+//valid until ReleaseNoiseJob, the callback may run before this returns.
+//Returns 0 for invalid parameters or if the map can't be allocated.
+NoiseJob* SubmitSphereSurfaceJob(const NoiseParams* P, int width, int height, NoiseJobCallback callback, void* userData)
+{
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	if (width < 1 || height < 1) return 0;
+	if (!SelectFractalSIMD(P->fractalType, P->octaves, &fractalFunction)) return 0;
+	if (!SelectNoiseSIMD(P->noiseType, &noiseFunction, P->quality)) return 0;
+
+	void* memory = _aligned_malloc(sizeof(NoiseJob), MEMORY_ALIGNMENT);
+	float* result = (float*)_aligned_malloc((size_t)width*height*sizeof(float), MEMORY_ALIGNMENT);
+	if (!memory || !result)
+	{
+		_aligned_free(memory);
+		_aligned_free(result);
+		return 0;
+	}
+	NoiseJob* job = new (memory) NoiseJob;
+	initSIMD(&job->S, P->frequency, P->lacunarity, P->offset, P->gain, P->octaves);
+	job->fractalFunction = fractalFunction;
+	job->noiseFunction = noiseFunction;
+	InitSphereTable(&job->T, width, height, P->seed);
+	job->width = width;
+	job->height = height;
+	int grain = GetSchedulerGrain();
+	job->bands = ChunkCount(height, grain);
+	job->result = result;
+	job->bandMin = new float[job->bands];
+	job->bandMax = new float[job->bands];
+	job->bandDone = new bool[job->bands];
+	job->callback = callback;
+	job->userData = userData;
+	job->rowsDone = 0;
+	job->cancelled = false;
+	job->references = 2;
+	job->status = JOB_RUNNING;
+	job->min = 0;
+	job->max = 0;
+
+	SubmitParallelFor(height, grain, runBand, job, finishJob);
+	return job;
+}
+
+int GetNoiseJobStatus(NoiseJob* job)
+{
+	std::lock_guard<std::mutex> guard(job->lock);
+	return job->status;
+}
+
+//Fraction of rows generated so far
+float GetNoiseJobProgress(NoiseJob* job, int* rowsDone, int* rowsTotal)
+{
+	int done = job->rowsDone;
+	if (rowsDone) *rowsDone = done;
+	if (rowsTotal) *rowsTotal = job->height;
+	return (float)done / job->height;
+}
+
+//Workers stop at the next row, the job then ends as JOB_CANCELLED
+void CancelNoiseJob(NoiseJob* job)
+{
+	job->cancelled = true;
+}
+
+//Blocks until the job has stopped and returns how it ended. Runs the job's queued
+//bands first, called from a worker they may sit on its own deque.
+int WaitNoiseJob(NoiseJob* job)
+{
+	while (RunQueuedChunk(job)) {}
+	std::unique_lock<std::mutex> guard(job->lock);
+	job->finished.wait(guard, [job] { return job->status != JOB_RUNNING; });
+	return job->status;
+}
+
+//Waits for the job and hands over its result, which must then be freed with
+//CleanUpNoiseSIMD. Returns 0 for cancelled jobs or if the result was taken.
+float* TakeNoiseJobResult(NoiseJob* job, float* outMin, float* outMax)
+{
+	if (WaitNoiseJob(job) != JOB_DONE) return 0;
+	std::lock_guard<std::mutex> guard(job->lock);
+	float* result = job->result;
+	job->result = 0;
+	*outMin = job->min;
+	*outMax = job->max;
+	return result;
+}
+
+//Gives up the handle, a job still running is cancelled first
+void ReleaseNoiseJob(NoiseJob* job)
+{
+	if (!job) return;
+	job->cancelled = true;
+	releaseJob(job);
+}
@@ -0,0 +1,321 @@
+#include "headers\NoiseLayout.h"
+#include "headers\TileScheduler.h"
+#include "headers\NoiseStats.h"
+
+//Positions are generated in increasing layout order, a kernel call covers
+//LAYOUT_BATCH consecutive floats of the output so every store is sequential
+#define LAYOUT_BATCH (VECTOR_SIZE*KERNEL_UNROLL)
+
+//Sizes of a map or volume in one place, dims is 2 or 3
+struct LayoutShape
+{
+	int layout;
+	int dims;
+	int size[3];
+	int bits[3]; //log2 of the sizes, for MORTON
+	int bricks[3]; //bricks per axis, for BRICKED
+	int brick;
+};
+
+static int log2Exact(int n)
+{
+	int bits = 0;
+	while ((1 << bits) < n) bits++;
+	return (1 << bits) == n ? bits : -1;
+}
+
+static bool initShape(LayoutShape* L, int layout, int sizeX, int sizeY, int sizeZ)
+{
+	L->layout = layout;
+	L->dims = sizeZ > 0 ? 3 : 2;
+	L->size[0] = sizeX;
+	L->size[1] = sizeY;
+	L->size[2] = sizeZ > 0 ? sizeZ : 1;
+	L->brick = L->dims == 3 ? BRICK_3D : BRICK_2D;
+	if (sizeX < 1 || sizeY < 1 || sizeZ < 0) return false;
+	for (int a = 0; a < 3; a++)
+	{
+		L->bits[a] = log2Exact(L->size[a]);
+		L->bricks[a] = a < L->dims ? (L->size[a] + L->brick - 1) / L->brick : 1;
+		if (layout == LAYOUT_MORTON && L->bits[a] < 0) return false;
+	}
+	return layout == LAYOUT_ROW_MAJOR || layout == LAYOUT_MORTON || layout == LAYOUT_BRICKED;
+}
+
+static size_t shapeSize(const LayoutShape* L)
+{
+	if (L->layout != LAYOUT_BRICKED) return (size_t)L->size[0] * L->size[1] * L->size[2];
+	size_t brickSize = L->dims == 3 ? L->brick*L->brick*L->brick : L->brick*L->brick;
+	return (size_t)L->bricks[0] * L->bricks[1] * L->bricks[2] * brickSize;
+}
+
+static size_t encode(const LayoutShape* L, const int* p)
+{
+	switch (L->layout)
+	{
+	case LAYOUT_MORTON:
+	{
+		//one bit of every axis that has bits left, lowest first
+		size_t index = 0;
+		int shift = 0;
+		for (int bit = 0; shift < L->bits[0] + L->bits[1] + L->bits[2]; bit++)
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				if (bit < L->bits[a]) index |= (size_t)((p[a] >> bit) & 1) << shift++;
+			}
+		}
+		return index;
+	}
+	case LAYOUT_BRICKED:
+	{
+		int b = L->brick;
+		size_t brick = ((size_t)(p[2] / b) * L->bricks[1] + p[1] / b) * L->bricks[0] + p[0] / b;
+		size_t inside = L->dims == 3 ? ((size_t)(p[2] % b) * b + p[1] % b) * b + p[0] % b : (size_t)(p[1] % b) * b + p[0] % b;
+		return brick * (L->dims == 3 ? b*b*b : b*b) + inside;
+	}
+	default:
+		return ((size_t)p[2] * L->size[1] + p[1]) * L->size[0] + p[0];
+	}
+}
+
+//Sample at output position index, the padding of edge bricks decodes past the sizes
+static void decode(const LayoutShape* L, size_t index, int* p)
+{
+	switch (L->layout)
+	{
+	case LAYOUT_MORTON:
+		p[0] = p[1] = p[2] = 0;
+		for (int bit = 0; index; bit++)
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				if (bit < L->bits[a])
+				{
+					p[a] |= (int)(index & 1) << bit;
+					index >>= 1;
+				}
+			}
+		}
+		break;
+	case LAYOUT_BRICKED:
+	{
+		int b = L->brick;
+		size_t brickSize = L->dims == 3 ? b*b*b : b*b;
+		size_t brick = index / brickSize;
+		int inside = (int)(index % brickSize);
+		p[0] = (int)(brick % L->bricks[0]) * b + inside % b;
+		p[1] = (int)(brick / L->bricks[0] % L->bricks[1]) * b + inside / b % b;
+		p[2] = (int)(brick / ((size_t)L->bricks[0] * L->bricks[1])) * b + (L->dims == 3 ? inside / (b*b) : 0);
+		break;
+	}
+	default:
+		p[0] = (int)(index % L->size[0]);
+		p[1] = (int)(index / L->size[0] % L->size[1]);
+		p[2] = (int)(index / ((size_t)L->size[0] * L->size[1]));
+	}
+}
+
+//Padding is clamped to the last sample so it repeats real values and never disturbs min/max
+static inline void clampPosition(const LayoutShape* L, int* p)
+{
+	for (int a = 0; a < 3; a++) p[a] = p[a] < L->size[a] ? p[a] : L->size[a] - 1;
+}
+
+size_t GetLayoutSize(int layout, int sizeX, int sizeY, int sizeZ)
+{
+	LayoutShape L;
+	if (!initShape(&L, layout, sizeX, sizeY, sizeZ)) return 0;
+	return shapeSize(&L);
+}
+
+size_t GetLayoutIndex(int layout, int x, int y, int z, int sizeX, int sizeY, int sizeZ)
+{
+	LayoutShape L;
+	initShape(&L, layout, sizeX, sizeY, sizeZ);
+	int p[3] = { x, y, z };
+	return encode(&L, p);
+}
+
+struct LayoutContext
+{
+	float* result;
+	const LayoutShape* L;
+	size_t total;
+	//Morton and brick positions of a vector aligned to VECTOR_SIZE are the position of
+	//its first lane plus these, so only one position per vector is decoded
+	bool laneOffsets;
+	int laneOffset[VECTOR_SIZE][3];
+	const Settings* S;
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	//sphere maps
+	const SphereTable* T;
+	const float* rowSin;
+	const float* rowZ;
+	//volumes, seed offset included
+	float origin[3];
+	float spacing;
+	float* chunkMin;
+	float* chunkMax;
+};
+
+static void layoutChunk(void* context, int begin, int end, int chunk)
+{
+	LayoutContext* C = (LayoutContext*)context;
+	SIMD min = SetOne(999);
+	SIMD max = SetOne(-999);
+	uSIMD x[KERNEL_UNROLL], y[KERNEL_UNROLL], z[KERNEL_UNROLL];
+	float* fx = (float*)x;
+	float* fy = (float*)y;
+	float* fz = (float*)z;
+	for (int batch = begin; batch < end; batch++)
+	{
+		size_t first = (size_t)batch * LAYOUT_BATCH;
+		int count = C->total - first < LAYOUT_BATCH ? (int)(C->total - first) : LAYOUT_BATCH;
+		int p[LAYOUT_BATCH][3];
+		for (int v = 0; v < LAYOUT_BATCH; v += VECTOR_SIZE)
+		{
+			if (C->laneOffsets && v + VECTOR_SIZE <= count)
+			{
+				int base[3];
+				decode(C->L, first + v, base);
+				for (int j = 0; j < VECTOR_SIZE; j++)
+				{
+					for (int a = 0; a < 3; a++) p[v + j][a] = base[a] + C->laneOffset[j][a];
+				}
+			}
+			else
+			{
+				//lanes past the end repeat the last position
+				for (int j = 0; j < VECTOR_SIZE; j++) decode(C->L, first + (v + j < count ? v + j : count - 1), p[v + j]);
+			}
+		}
+		for (int i = 0; i < LAYOUT_BATCH; i++) clampPosition(C->L, p[i]);
+		if (C->T)
+		{
+			for (int i = 0; i < LAYOUT_BATCH; i++)
+			{
+				float sinPhi = C->rowSin[p[i][1]];
+				fx[i] = C->T->xcos[p[i][0]] * sinPhi + C->T->originX;
+				fy[i] = C->T->ysin[p[i][0]] * sinPhi + C->T->originY;
+				fz[i] = C->rowZ[p[i][1]];
+			}
+		}
+		else
+		{
+			for (int i = 0; i < LAYOUT_BATCH; i++)
+			{
+				fx[i] = C->origin[0] + p[i][0] * C->spacing;
+				fy[i] = C->origin[1] + p[i][1] * C->spacing;
+				fz[i] = C->origin[2] + p[i][2] * C->spacing;
+			}
+		}
+		SIMD vx[KERNEL_UNROLL], vy[KERNEL_UNROLL], vz[KERNEL_UNROLL], r[KERNEL_UNROLL];
+		for (int u = 0; u < KERNEL_UNROLL; u++)
+		{
+			vx[u] = x[u].m;
+			vy[u] = y[u].m;
+			vz[u] = z[u].m;
+		}
+		C->fractalFunction(r, vx, vy, vz, C->S, C->noiseFunction);
+		for (int u = 0; u < KERNEL_UNROLL && u*VECTOR_SIZE < count; u++)
+		{
+			min = Min(min, r[u]);
+			max = Max(max, r[u]);
+			int lanes = count - u*VECTOR_SIZE;
+			StorePartial(C->result + first + u*VECTOR_SIZE, r[u], lanes < VECTOR_SIZE ? lanes : VECTOR_SIZE);
+		}
+	}
+	ReduceMinMax(&min, &max, &C->chunkMin[chunk], &C->chunkMax[chunk]);
+}
+
+//Runs the batches of C over the scheduler, about as many floats per chunk as grain rows of a map
+static void fillLayout(LayoutContext* C, float* outMin, float* outMax)
+{
+	//a vector stays inside one brick row (or two rows of a 4 wide 3D brick)
+	C->laneOffsets = C->L->layout == LAYOUT_MORTON || C->L->layout == LAYOUT_BRICKED;
+	for (int j = 0; j < VECTOR_SIZE; j++) decode(C->L, j, C->laneOffset[j]);
+	int batches = (int)((C->total + LAYOUT_BATCH - 1) / LAYOUT_BATCH);
+	int grain = GetSchedulerGrain() * C->L->size[0] / LAYOUT_BATCH;
+	if (grain < 1) grain = 1;
+	int chunks = ChunkCount(batches, grain);
+	C->chunkMin = new float[chunks];
+	C->chunkMax = new float[chunks];
+	STATS_BEGIN(kernel);
+	ParallelFor(batches, grain, layoutChunk, C);
+	STATS_END(kernel, PHASE_KERNEL);
+	ReduceChunkMinMax(C->chunkMin, C->chunkMax, chunks, outMin, outMax);
+	delete[] C->chunkMin;
+	delete[] C->chunkMax;
+}
+
+bool FillSphereSurfaceLayoutSIMD(float* result, const NoiseParams* P, int width, int height, int layout, float* outMin, float* outMax)
+{
+	FIXED_FLOAT_STATE();
+	//the row generator already writes in row major order
+	if (layout == LAYOUT_ROW_MAJOR) return FillSphereSurfaceTileSIMD(result, P, width, height, 0, 0, width, height, outMin, outMax);
+	STATS_BEGIN(setup);
+	LayoutShape L;
+	if (!initShape(&L, layout, width, height, 0)) return false;
+	LayoutContext C;
+	if (!SelectFractalSIMD(P->fractalType, P->octaves, &C.fractalFunction)) return false;
+	if (!SelectNoiseSIMD(P->noiseType, &C.noiseFunction, P->quality)) return false;
+
+	SphereTable T;
+	InitSphereTable(&T, width, height, P->seed);
+	Settings S;
+	initSIMD(&S, P->frequency, P->lacunarity, P->offset, P->gain, P->octaves);
+	//same values as SphereRowSIMD, so every layout matches the row major map bit for bit
+	float* rowSin = new float[2 * height];
+	float* rowZ = rowSin + height;
+	Settings row;
+	for (int y = 0; y < height; y++)
+	{
+		rowSin[y] = SphereRowSIMD(&row, &T, y);
+		rowZ[y] = row.z.a[0];
+	}
+	C.result = result;
+	C.L = &L;
+	C.total = shapeSize(&L);
+	C.S = &S;
+	C.T = &T;
+	C.rowSin = rowSin;
+	C.rowZ = rowZ;
+	STATS_END(setup, PHASE_SETUP);
+
+	fillLayout(&C, outMin, outMax);
+	STATS_COUNT((uint64_t)C.total, P->fractalType == PLAIN ? 1 : P->octaves);
+	delete[] rowSin;
+	FreeSphereTable(&T);
+	return true;
+}
+
+bool FillVolumeLayoutSIMD(float* result, const NoiseParams* P, float originX, float originY, float originZ, float spacing, int sizeX, int sizeY, int sizeZ, int layout, float* outMin, float* outMax)
+{
+	FIXED_FLOAT_STATE();
+	STATS_BEGIN(setup);
+	LayoutShape L;
+	if (sizeZ < 1 || !initShape(&L, layout, sizeX, sizeY, sizeZ)) return false;
+	LayoutContext C;
+	if (!SelectFractalSIMD(P->fractalType, P->octaves, &C.fractalFunction)) return false;
+	if (!SelectNoiseSIMD(P->noiseType, &C.noiseFunction, P->quality)) return false;
+
+	Settings S;
+	initSIMD(&S, P->frequency, P->lacunarity, P->offset, P->gain, P->octaves);
+	C.result = result;
+	C.L = &L;
+	C.total = shapeSize(&L);
+	C.S = &S;
+	C.T = 0;
+	SeedOffset(P->seed, &C.origin[0], &C.origin[1], &C.origin[2]);
+	C.origin[0] += originX;
+	C.origin[1] += originY;
+	C.origin[2] += originZ;
+	C.spacing = spacing;
+	STATS_END(setup, PHASE_SETUP);
+
+	fillLayout(&C, outMin, outMax);
+	STATS_COUNT((uint64_t)C.total, P->fractalType == PLAIN ? 1 : P->octaves);
+	return true;
+}
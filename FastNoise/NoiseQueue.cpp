@@ -0,0 +1,231 @@
+#include "headers\NoiseQueue.h"
+#include "headers\TileScheduler.h"
+#include <new>
+#include <atomic>
+#include <thread>
+
+//Lanes per kernel call, and kernel calls per scheduler chunk so small flushes stay on the calling thread
+#define QUEUE_BATCH (VECTOR_SIZE*KERNEL_UNROLL)
+#define QUEUE_GRAIN 16
+
+struct NoiseQuery
+{
+	float x;
+	float y;
+	float z;
+	int settings;
+	std::atomic<uint32_t> stamp; //epoch + 1 once x, y, z and settings of that epoch are written
+};
+
+//Two query buffers take turns: enqueues fill the one of the current epoch while a
+//flush evaluates the other, whose results stay readable until the next flush
+struct NoiseQueue
+{
+	int settingsCount;
+	int capacity;
+	Settings* S;
+	ISIMDFractal3dN* fractalFunction;
+	ISIMDNoise3dN* noiseFunction;
+	float* seedOffset; //x, y, z translation of every settings
+	NoiseQuery* queries[2];
+	float* results[2];
+	int* order; //query indices of a flush grouped by settings
+	int* groupStart;
+	//epoch in the high 32 bits, queries claimed in it in the low ones
+	std::atomic<uint64_t> state;
+	std::atomic<int64_t> flushedEpoch;
+	std::atomic<int> flushedCount;
+};
+
+//A run of up to QUEUE_BATCH queries of one settings
+struct QueueBatch
+{
+	int settings;
+	int begin;
+	int end;
+};
+
+struct QueueContext
+{
+	const NoiseQueue* queue;
+	const NoiseQuery* queries;
+	float* results;
+	const QueueBatch* batches;
+};
+
+//Epoch (kept positive) in the high 32 bits, query index in the low ones
+static inline int64_t makeTicket(uint32_t epoch, int index)
+{
+	return (int64_t)(epoch & 0x7fffffff) << 32 | index;
+}
+
+static void queueChunk(void* context, int begin, int end, int)
+{
+	const QueueContext* C = (const QueueContext*)context;
+	const NoiseQueue* Q = C->queue;
+	for (int b = begin; b < end; b++)
+	{
+		const QueueBatch* B = &C->batches[b];
+		const float* offset = &Q->seedOffset[3 * B->settings];
+		uSIMD x[KERNEL_UNROLL], y[KERNEL_UNROLL], z[KERNEL_UNROLL], r[KERNEL_UNROLL];
+		float* fx = (float*)x;
+		float* fy = (float*)y;
+		float* fz = (float*)z;
+		//unused lanes repeat the last query
+		for (int i = 0; i < QUEUE_BATCH; i++)
+		{
+			int k = B->begin + i < B->end ? B->begin + i : B->end - 1;
+			const NoiseQuery* q = &C->queries[Q->order[k]];
+			fx[i] = q->x + offset[0];
+			fy[i] = q->y + offset[1];
+			fz[i] = q->z + offset[2];
+		}
+		SIMD vx[KERNEL_UNROLL], vy[KERNEL_UNROLL], vz[KERNEL_UNROLL];
+		for (int u = 0; u < KERNEL_UNROLL; u++)
+		{
+			vx[u] = x[u].m;
+			vy[u] = y[u].m;
+			vz[u] = z[u].m;
+		}
+		Q->fractalFunction[B->settings](&r[0].m, vx, vy, vz, &Q->S[B->settings], Q->noiseFunction[B->settings]);
+		const float* values = (const float*)r;
+		for (int k = B->begin; k < B->end; k++) C->results[Q->order[k]] = values[k - B->begin];
+	}
+}
+
+NoiseQueue* CreateNoiseQueue(const NoiseParams* settings, int settingsCount, int capacity)
+{
+	if (settingsCount < 1 || capacity < 1) return 0;
+	ISIMDFractal3dN* fractalFunction = new ISIMDFractal3dN[settingsCount];
+	ISIMDNoise3dN* noiseFunction = new ISIMDNoise3dN[settingsCount];
+	for (int i = 0; i < settingsCount; i++)
+	{
+		if (!SelectFractalSIMD(settings[i].fractalType, settings[i].octaves, &fractalFunction[i]) || !SelectNoiseSIMD(settings[i].noiseType, &noiseFunction[i], settings[i].quality))
+		{
+			delete[] fractalFunction;
+			delete[] noiseFunction;
+			return 0;
+		}
+	}
+
+	NoiseQueue* queue = new NoiseQueue;
+	queue->settingsCount = settingsCount;
+	queue->capacity = capacity;
+	queue->fractalFunction = fractalFunction;
+	queue->noiseFunction = noiseFunction;
+	queue->S = (Settings*)_aligned_malloc(settingsCount*sizeof(Settings), MEMORY_ALIGNMENT);
+	queue->seedOffset = new float[3 * settingsCount];
+	for (int i = 0; i < settingsCount; i++)
+	{
+		const NoiseParams* P = &settings[i];
+		initSIMD(&queue->S[i], P->frequency, P->lacunarity, P->offset, P->gain, P->octaves);
+		SeedOffset(P->seed, &queue->seedOffset[3 * i], &queue->seedOffset[3 * i + 1], &queue->seedOffset[3 * i + 2]);
+	}
+	for (int b = 0; b < 2; b++)
+	{
+		queue->queries[b] = new NoiseQuery[capacity];
+		for (int i = 0; i < capacity; i++) queue->queries[b][i].stamp.store(0, std::memory_order_relaxed);
+		queue->results[b] = new float[capacity];
+	}
+	queue->order = new int[capacity];
+	queue->groupStart = new int[settingsCount + 1];
+	queue->state.store(0);
+	queue->flushedEpoch.store(-1);
+	queue->flushedCount = 0;
+	return queue;
+}
+
+void DestroyNoiseQueue(NoiseQueue* queue)
+{
+	if (!queue) return;
+	for (int b = 0; b < 2; b++)
+	{
+		delete[] queue->queries[b];
+		delete[] queue->results[b];
+	}
+	delete[] queue->order;
+	delete[] queue->groupStart;
+	delete[] queue->seedOffset;
+	delete[] queue->fractalFunction;
+	delete[] queue->noiseFunction;
+	_aligned_free(queue->S);
+	delete queue;
+}
+
+int64_t EnqueueNoiseQuery(NoiseQueue* queue, float x, float y, float z, int settings)
+{
+	if (settings < 0 || settings >= queue->settingsCount) return -1;
+	//claiming the slot is the only shared write, the flush waits for the stamp
+	uint64_t state = queue->state.fetch_add(1, std::memory_order_acquire);
+	uint32_t epoch = (uint32_t)(state >> 32);
+	uint32_t index = (uint32_t)state;
+	if (index >= (uint32_t)queue->capacity) return -1;
+	NoiseQuery* q = &queue->queries[epoch & 1][index];
+	q->x = x;
+	q->y = y;
+	q->z = z;
+	q->settings = settings;
+	q->stamp.store(epoch + 1, std::memory_order_release);
+	return makeTicket(epoch, (int)index);
+}
+
+int FlushNoiseQueue(NoiseQueue* queue, NoiseQueryCallback callback, void* userData)
+{
+	//start the next epoch, later enqueues go to the other buffer
+	uint32_t epoch = (uint32_t)(queue->state.load(std::memory_order_relaxed) >> 32);
+	uint64_t state = queue->state.exchange((uint64_t)(epoch + 1) << 32, std::memory_order_acq_rel);
+	int count = (uint32_t)state < (uint32_t)queue->capacity ? (int)(uint32_t)state : queue->capacity;
+	NoiseQuery* queries = queue->queries[epoch & 1];
+	float* results = queue->results[epoch & 1];
+
+	//wait for enqueues that claimed a slot but haven't written it yet, and
+	//group the queries by settings keeping ticket order inside each group
+	int* start = queue->groupStart;
+	for (int s = 0; s <= queue->settingsCount; s++) start[s] = 0;
+	for (int i = 0; i < count; i++)
+	{
+		while (queries[i].stamp.load(std::memory_order_acquire) != epoch + 1) std::this_thread::yield();
+		start[queries[i].settings + 1]++;
+	}
+	for (int s = 0; s < queue->settingsCount; s++) start[s + 1] += start[s];
+	for (int i = 0; i < count; i++) queue->order[start[queries[i].settings]++] = i;
+	for (int s = queue->settingsCount; s > 0; s--) start[s] = start[s - 1];
+	start[0] = 0;
+
+	int batchCount = 0;
+	for (int s = 0; s < queue->settingsCount; s++) batchCount += (start[s + 1] - start[s] + QUEUE_BATCH - 1) / QUEUE_BATCH;
+	QueueBatch* batches = new QueueBatch[batchCount > 0 ? batchCount : 1];
+	batchCount = 0;
+	for (int s = 0; s < queue->settingsCount; s++)
+	{
+		for (int k = start[s]; k < start[s + 1]; k += QUEUE_BATCH)
+		{
+			QueueBatch B = { s, k, k + QUEUE_BATCH < start[s + 1] ? k + QUEUE_BATCH : start[s + 1] };
+			batches[batchCount++] = B;
+		}
+	}
+	QueueContext C = { queue, queries, results, batches };
+	ParallelFor(batchCount, QUEUE_GRAIN, queueChunk, &C);
+	delete[] batches;
+
+	queue->flushedCount.store(count, std::memory_order_relaxed);
+	queue->flushedEpoch.store(epoch & 0x7fffffff, std::memory_order_release);
+	if (callback)
+	{
+		for (int k = 0; k < count; k++)
+		{
+			int i = queue->order[k];
+			callback(makeTicket(epoch, i), queries[i].settings, results[i], userData);
+		}
+	}
+	return count;
+}
+
+bool GetNoiseQueryResult(const NoiseQueue* queue, int64_t ticket, float* value)
+{
+	if (ticket < 0 || (ticket >> 32) != queue->flushedEpoch.load(std::memory_order_acquire)) return false;
+	int index = (int)(ticket & 0xffffffff);
+	if (index >= queue->flushedCount.load(std::memory_order_relaxed)) return false;
+	*value = queue->results[ticket >> 32 & 1][index];
+	return true;
+}
@@ -0,0 +1,188 @@
+#include "headers\NoiseStats.h"
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static std::atomic<uint64_t> statCalls(0);
+static std::atomic<uint64_t> statSamples(0);
+static std::atomic<uint64_t> statOctaves(0);
+static std::atomic<uint64_t> statPhases[4];
+static std::atomic<uint64_t> statCycles(0);
+static std::atomic<uint64_t> statInstructions(0);
+static std::atomic<uint64_t> statCacheMisses(0);
+static std::atomic<int> statCountersValid(0);
+static std::atomic<bool> countersEnabled(false);
+//set and read as a pair
+static std::mutex traceLock;
+static NoiseTraceCallback traceCallback = 0;
+static void* traceUserData = 0;
+
+
+uint64_t NoiseStatsNow()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void NoiseStatsPhase(int phase, uint64_t ns)
+{
+	statPhases[phase] += ns;
+	NoiseTraceCallback callback;
+	void* userData;
+	{
+		std::lock_guard<std::mutex> guard(traceLock);
+		callback = traceCallback;
+		userData = traceUserData;
+	}
+	if (callback) callback(phase, ns, userData);
+}
+
+void NoiseStatsCount(uint64_t samples, uint64_t octaves)
+{
+	statCalls++;
+	statSamples += samples;
+	statOctaves += samples*octaves;
+}
+
+void GetNoiseStats(NoiseStats* stats)
+{
+	memset(stats, 0, sizeof(NoiseStats));
+	stats->calls = statCalls;
+	stats->samples = statSamples;
+	stats->octaves = statOctaves;
+	stats->allocationNs = statPhases[PHASE_ALLOCATION];
+	stats->setupNs = statPhases[PHASE_SETUP];
+	stats->kernelNs = statPhases[PHASE_KERNEL];
+	stats->reductionNs = statPhases[PHASE_REDUCTION];
+	stats->nsPerSample = stats->samples ? (double)stats->kernelNs / stats->samples : 0;
+	stats->countersValid = statCountersValid;
+	stats->cycles = statCycles;
+	stats->instructions = statInstructions;
+	stats->cacheMisses = statCacheMisses;
+}
+
+void ResetNoiseStats()
+{
+	statCalls = 0;
+	statSamples = 0;
+	statOctaves = 0;
+	for (int i = 0; i < 4; i++) statPhases[i] = 0;
+	statCycles = 0;
+	statInstructions = 0;
+	statCacheMisses = 0;
+	statCountersValid = 0;
+}
+
+//The callback gets every phase of every call as it finishes, from the thread that ran it.
+//A phase finishing while this runs may still go to the previous callback.
+void SetNoiseTraceCallback(NoiseTraceCallback callback, void* userData)
+{
+	std::lock_guard<std::mutex> guard(traceLock);
+	traceCallback = callback;
+	traceUserData = userData;
+}
+
+
+#ifdef __linux__
+//One counter group per thread, opened the first time that thread runs a chunk
+//and closed when the thread exits, so restarting the scheduler doesn't leak it
+struct PerfGroup
+{
+	int fd[3];
+	bool opened;
+	bool failed;
+	int depth; //chunks running on this thread, a nested ParallelFor runs them inside another
+	~PerfGroup()
+	{
+		if (opened) for (int i = 0; i < 3; i++) close(fd[i]);
+	}
+};
+static thread_local PerfGroup perfGroup = { { -1, -1, -1 }, false, false, 0 };
+
+static int openCounter(uint64_t config, int group)
+{
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.disabled = group == -1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static bool openGroup()
+{
+	PerfGroup& g = perfGroup;
+	if (g.opened) return true;
+	if (g.failed) return false;
+	g.fd[0] = openCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+	if (g.fd[0] >= 0)
+	{
+		g.fd[1] = openCounter(PERF_COUNT_HW_INSTRUCTIONS, g.fd[0]);
+		g.fd[2] = openCounter(PERF_COUNT_HW_CACHE_MISSES, g.fd[0]);
+	}
+	if (g.fd[0] < 0 || g.fd[1] < 0 || g.fd[2] < 0)
+	{
+		for (int i = 0; i < 3; i++) if (g.fd[i] >= 0) close(g.fd[i]);
+		g.failed = true;
+		return false;
+	}
+	g.opened = true;
+	return true;
+}
+#endif
+
+//Returns false when hardware counters are not available on this platform or to this process
+bool EnableNoiseCounters(bool enable)
+{
+#ifdef __linux__
+	if (enable && !openGroup()) return false;
+	countersEnabled = enable;
+	return true;
+#endif
+#ifndef __linux__
+	return !enable;
+#endif
+}
+
+//Only the outermost chunk of a thread resets and reads the group, nested chunks
+//are counted as part of it
+void NoiseCountersBegin()
+{
+#ifdef __linux__
+	if (perfGroup.depth > 0)
+	{
+		perfGroup.depth++;
+		return;
+	}
+	if (!countersEnabled || !openGroup()) return;
+	perfGroup.depth = 1;
+	ioctl(perfGroup.fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(perfGroup.fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+void NoiseCountersEnd()
+{
+#ifdef __linux__
+	if (perfGroup.depth == 0 || --perfGroup.depth > 0) return;
+	ioctl(perfGroup.fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	uint64_t values[4]; //count followed by the three counters
+	if (read(perfGroup.fd[0], values, sizeof(values)) == sizeof(values))
+	{
+		statCycles += values[1];
+		statInstructions += values[2];
+		statCacheMisses += values[3];
+		statCountersValid = 1;
+	}
+#endif
+}
@@ -0,0 +1,210 @@
+#include "headers\NoiseStream.h"
+#include "headers\TileScheduler.h"
+#include "headers\NoiseStats.h"
+#include <mutex>
+#include <condition_variable>
+
+#define DEFAULT_RING_SIZE 3
+
+struct NoiseStream;
+
+//One buffer of the ring and the band currently generated into it
+struct StreamSlot
+{
+	NoiseStream* stream;
+	float* rows;
+	int y0;
+	int chunks;
+	float* chunkMin;
+	float* chunkMax;
+	//summarized while the band is generated, added to the summary once it is delivered
+	SummaryThreads histograms;
+	double* rowSum;
+	double* rowSquares;
+	bool ready;
+};
+
+struct NoiseStream
+{
+	const Settings* S;
+	const SphereTable* T;
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	int width;
+	int grain;
+	const NoiseSummary* summary; //null when only min/max are wanted
+	std::mutex lock;
+	std::condition_variable bandReady;
+};
+
+static void streamChunk(void* context, int begin, int end, int chunk)
+{
+	StreamSlot* slot = (StreamSlot*)context;
+	NoiseStream* stream = slot->stream;
+	Settings S = *stream->S;
+	SIMD min = SetOne(999);
+	SIMD max = SetOne(-999);
+	SummaryPartial partial;
+	if (stream->summary) BeginSummaryPartial(&partial, stream->summary, &slot->histograms);
+	for (int y = begin; y < end; y++)
+	{
+		float* row = slot->rows + (size_t)y*stream->width;
+		FillSphereRowSIMD(row, stream->T, slot->y0 + y, 0, stream->width, &S, stream->fractalFunction, stream->noiseFunction, &min, &max);
+		if (stream->summary) SummarizeRow(&partial, stream->summary, row, stream->width, &slot->rowSum[y], &slot->rowSquares[y]);
+	}
+	ReduceMinMax(&min, &max, &slot->chunkMin[chunk], &slot->chunkMax[chunk]);
+	if (stream->summary) EndSummaryPartial(&partial, stream->summary, &slot->histograms);
+}
+
+static void streamBandDone(void* context)
+{
+	StreamSlot* slot = (StreamSlot*)context;
+	std::lock_guard<std::mutex> guard(slot->stream->lock);
+	slot->ready = true;
+	slot->stream->bandReady.notify_all();
+}
+
+//Runs the band's queued chunks on the calling thread before sleeping on it. Its
+//chunks may sit on this thread's own deque when it is a worker, nobody else
+//would take them with a single worker.
+static void waitBand(StreamSlot* slot)
+{
+	while (RunQueuedChunk(slot)) {}
+	std::unique_lock<std::mutex> guard(slot->stream->lock);
+	slot->stream->bandReady.wait(guard, [slot] { return slot->ready; });
+}
+
+static void submitBand(StreamSlot* slot, int y0, int rows)
+{
+	slot->y0 = y0;
+	slot->ready = false;
+	if (slot->stream->summary) BeginSummaryThreads(&slot->histograms, slot->stream->summary);
+	SubmitParallelFor(rows, slot->stream->grain, streamChunk, slot, streamBandDone);
+}
+
+//Generates a sphere map a band of rows at a time into a ring of ringSize buffers
+//and hands every band to sink, so only the ring is ever resident. The next bands
+//are generated on the scheduler while sink works on the current one. Returns
+//false if sink stopped the stream early, min/max then cover the bands delivered.
+//Shared by both stream functions, summary is null for min/max only.
+static bool streamSphere(const NoiseParams* P, int width, int height, int bandRows, int ringSize, NoiseBandSink sink, void* userData, float* outMin, float* outMax, NoiseSummary* summary)
+{
+	STATS_BEGIN(setup);
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	if (width < 1 || height < 1 || !sink) return false;
+	if (!SelectFractalSIMD(P->fractalType, P->octaves, &fractalFunction)) return false;
+	if (!SelectNoiseSIMD(P->noiseType, &noiseFunction, P->quality)) return false;
+	if (bandRows <= 0) bandRows = GetSchedulerGrain();
+	if (bandRows > height) bandRows = height;
+	if (ringSize <= 0) ringSize = DEFAULT_RING_SIZE;
+	int bands = (height + bandRows - 1) / bandRows;
+	if (ringSize > bands) ringSize = bands;
+
+	SphereTable T;
+	InitSphereTable(&T, width, height, P->seed);
+	Settings S;
+	initSIMD(&S, P->frequency, P->lacunarity, P->offset, P->gain, P->octaves);
+
+	NoiseStream stream;
+	stream.S = &S;
+	stream.T = &T;
+	stream.fractalFunction = fractalFunction;
+	stream.noiseFunction = noiseFunction;
+	stream.width = width;
+	//split bands further so a single band still spreads over the workers
+	stream.grain = GetSchedulerGrain() < bandRows ? GetSchedulerGrain() : bandRows;
+	stream.summary = summary;
+	STATS_END(setup, PHASE_SETUP);
+
+	STATS_BEGIN(allocation);
+	StreamSlot* ring = new StreamSlot[ringSize];
+	for (int i = 0; i < ringSize; i++)
+	{
+		ring[i].stream = &stream;
+		ring[i].rows = (float*)_aligned_malloc((size_t)width*bandRows*sizeof(float), MEMORY_ALIGNMENT);
+		ring[i].chunks = ChunkCount(bandRows, stream.grain);
+		ring[i].chunkMin = new float[ring[i].chunks];
+		ring[i].chunkMax = new float[ring[i].chunks];
+		ring[i].rowSum = summary ? new double[bandRows] : 0;
+		ring[i].rowSquares = summary ? new double[bandRows] : 0;
+	}
+	STATS_END(allocation, PHASE_ALLOCATION);
+
+	STATS_BEGIN(kernel);
+	for (int b = 0; b < ringSize; b++)
+	{
+		int y0 = b*bandRows;
+		submitBand(&ring[b], y0, height - y0 < bandRows ? height - y0 : bandRows);
+	}
+
+	//bands are delivered in order, min/max and the summary folded in as they arrive
+	float min = 999;
+	float max = -999;
+	bool complete = true;
+	int submitted = ringSize;
+	for (int b = 0; b < bands; b++)
+	{
+		StreamSlot* slot = &ring[b % ringSize];
+		waitBand(slot);
+		int rows = height - slot->y0 < bandRows ? height - slot->y0 : bandRows;
+		float bandMin, bandMax;
+		ReduceChunkMinMax(slot->chunkMin, slot->chunkMax, ChunkCount(rows, stream.grain), &bandMin, &bandMax);
+		min = fminf(min, bandMin);
+		max = fmaxf(max, bandMax);
+		if (summary)
+		{
+			summary->count += (uint64_t)width*rows;
+			AddSummaryRows(summary, slot->rowSum, slot->rowSquares, rows);
+			EndSummaryThreads(&slot->histograms, summary);
+		}
+		if (!sink(slot->rows, slot->y0, rows, width, userData))
+		{
+			complete = false;
+			break;
+		}
+		if (submitted < bands)
+		{
+			int y0 = submitted*bandRows;
+			submitBand(slot, y0, height - y0 < bandRows ? height - y0 : bandRows);
+			submitted++;
+		}
+	}
+
+	//bands still in flight must finish before their buffers go away
+	//and the ones never delivered are left out of the summary
+	for (int i = 0; i < ringSize; i++)
+	{
+		waitBand(&ring[i]);
+		if (summary) EndSummaryThreads(&ring[i].histograms, 0);
+	}
+	STATS_END(kernel, PHASE_KERNEL);
+	STATS_COUNT((uint64_t)width*(submitted*bandRows < height ? submitted*bandRows : height), P->fractalType == PLAIN ? 1 : P->octaves);
+
+	for (int i = 0; i < ringSize; i++)
+	{
+		_aligned_free(ring[i].rows);
+		delete[] ring[i].chunkMin;
+		delete[] ring[i].chunkMax;
+		delete[] ring[i].rowSum;
+		delete[] ring[i].rowSquares;
+	}
+	delete[] ring;
+	FreeSphereTable(&T);
+	*outMin = min;
+	*outMax = max;
+	return complete;
+}
+
+bool StreamSphereSurfaceSIMD(const NoiseParams* P, int width, int height, int bandRows, int ringSize, NoiseBandSink sink, void* userData, float* outMin, float* outMax)
+{
+	return streamSphere(P, width, height, bandRows, ringSize, sink, userData, outMin, outMax, 0);
+}
+
+//Same, also filling in summary over the bands delivered, with the same sums as
+//FillSphereSurfaceTileSummarySIMD over those rows
+bool StreamSphereSurfaceSummarySIMD(const NoiseParams* P, int width, int height, int bandRows, int ringSize, NoiseBandSink sink, void* userData, NoiseSummary* summary)
+{
+	if (!BeginSummary(summary)) return false;
+	return streamSphere(P, width, height, bandRows, ringSize, sink, userData, &summary->min, &summary->max, summary);
+}
@@ -0,0 +1,162 @@
+#include "headers\NoiseSummary.h"
+#include "headers\TileScheduler.h"
+#include <string.h>
+#include <math.h>
+
+bool BeginSummary(NoiseSummary* S)
+{
+	S->count = 0;
+	S->sum = 0;
+	S->sumSquares = 0;
+	S->min = 999;
+	S->max = -999;
+	if (S->bins == 0) return true;
+	if (S->bins < 0 || S->bins > SUMMARY_MAX_BINS || !S->histogram || !(S->histogramMin < S->histogramMax)) return false;
+	memset(S->histogram, 0, S->bins * sizeof(uint64_t));
+	return true;
+}
+
+void BeginSummaryThreads(SummaryThreads* T, const NoiseSummary* S)
+{
+	T->count = S->bins ? GetSchedulerThreads() + 1 : 0;
+	T->histograms = T->count ? new uint64_t*[T->count] : 0;
+	T->overflow = 0;
+	for (int i = 0; i < T->count; i++) T->histograms[i] = 0;
+}
+
+void BeginSummaryPartial(SummaryPartial* P, const NoiseSummary* S, SummaryThreads* T)
+{
+	P->histogram = 0;
+	P->owned = false;
+	if (S->bins == 0) return;
+	//slot 0 is the calling thread, which only ever runs chunks of its own call
+	int slot = SchedulerWorkerIndex() + 1;
+	if (slot < T->count)
+	{
+		if (!T->histograms[slot]) T->histograms[slot] = new uint64_t[S->bins]();
+		P->histogram = T->histograms[slot];
+		return;
+	}
+	P->histogram = new uint64_t[S->bins]();
+	P->owned = true;
+}
+
+static inline int binOf(float v, float histogramMin, float scale, int bins)
+{
+	float t = floorf((v - histogramMin) * scale);
+	t = fminf(fmaxf(t, 0.0f), (float)(bins - 1));
+	return (int)t;
+}
+
+void SummarizeRow(SummaryPartial* P, const NoiseSummary* S, const float* row, int count, double* rowSum, double* rowSquares)
+{
+	double total = 0;
+	double totalSquares = 0;
+	float scale = S->bins / (S->histogramMax - S->histogramMin);
+	int x = 0;
+#ifndef DETERMINISTIC
+	SIMD sum = SetZero();
+	SIMD squares = SetZero();
+	SIMD low = SetOne(S->histogramMin);
+	SIMD vscale = SetOne(scale);
+	SIMD last = SetOne((float)(S->bins - 1));
+	for (; x + VECTOR_SIZE <= count; x += VECTOR_SIZE)
+	{
+		SIMD v = LoadU(row + x);
+		sum = Add(sum, v);
+		squares = Add(squares, Mul(v, v));
+		if (!P->histogram) continue;
+		uSIMDi bin;
+		bin.m = ConvertToInt(Min(Max(Floor(Mul(Sub(v, low), vscale)), SetZero()), last));
+		for (int j = 0; j < VECTOR_SIZE; j++) P->histogram[bin.a[j]]++;
+	}
+	uSIMD s, q;
+	s.m = sum;
+	q.m = squares;
+	for (int j = 0; j < VECTOR_SIZE; j++)
+	{
+		total += s.a[j];
+		totalSquares += q.a[j];
+	}
+#endif
+	//the tail, and everything in deterministic mode where the lane grouping would
+	//make the sums depend on the vector width
+	for (; x < count; x++)
+	{
+		double v = row[x];
+		total += v;
+		totalSquares += v*v;
+		if (P->histogram) P->histogram[binOf(row[x], S->histogramMin, scale, S->bins)]++;
+	}
+	*rowSum = total;
+	*rowSquares = totalSquares;
+}
+
+void AddSummaryRows(NoiseSummary* S, const double* rowSum, const double* rowSquares, int rows)
+{
+	for (int y = 0; y < rows; y++)
+	{
+		S->sum += rowSum[y];
+		S->sumSquares += rowSquares[y];
+	}
+}
+
+void EndSummaryPartial(SummaryPartial* P, const NoiseSummary* S, SummaryThreads* T)
+{
+	if (!P->owned) return;
+	{
+		std::lock_guard<std::mutex> guard(T->lock);
+		if (!T->overflow) T->overflow = new uint64_t[S->bins]();
+		for (int i = 0; i < S->bins; i++) T->overflow[i] += P->histogram[i];
+	}
+	delete[] P->histogram;
+	P->histogram = 0;
+}
+
+static void mergeHistogram(NoiseSummary* S, uint64_t* histogram)
+{
+	if (!histogram) return;
+	if (S) for (int i = 0; i < S->bins; i++) S->histogram[i] += histogram[i];
+	delete[] histogram;
+}
+
+void EndSummaryThreads(SummaryThreads* T, NoiseSummary* S)
+{
+	for (int t = 0; t < T->count; t++) mergeHistogram(S, T->histograms[t]);
+	mergeHistogram(S, T->overflow);
+	delete[] T->histograms;
+	T->count = 0;
+	T->histograms = 0;
+	T->overflow = 0;
+}
+
+float NoisePercentile(const NoiseSummary* S, float fraction)
+{
+	if (S->bins <= 0 || S->count == 0) return S->min;
+	double target = fminf(fmaxf(fraction, 0.0f), 1.0f) * (double)S->count;
+	double width = (double)(S->histogramMax - S->histogramMin) / S->bins;
+	uint64_t below = 0;
+	for (int i = 0; i < S->bins; i++)
+	{
+		if (S->histogram[i] > 0 && below + S->histogram[i] >= target)
+		{
+			//the samples of a bin are taken as spread evenly over it
+			double value = S->histogramMin + (i + (target - below) / S->histogram[i]) * width;
+			return fminf(fmaxf((float)value, S->min), S->max);
+		}
+		below += S->histogram[i];
+	}
+	return S->max;
+}
+
+void NoiseMeanVariance(const NoiseSummary* S, double* mean, double* variance)
+{
+	if (S->count == 0)
+	{
+		*mean = 0;
+		*variance = 0;
+		return;
+	}
+	*mean = S->sum / S->count;
+	*variance = fmax(S->sumSquares / S->count - *mean * *mean, 0.0);
+}
@@ -1,4 +1,7 @@
 #include "headers\NoiseUtility.h"
+#include "headers\NoiseStats.h"
+#include "headers\TileScheduler.h"
+#include "headers\Autotune.h"
 #include <stdio.h>
 
 
@@ -17,115 +20,315 @@ void CleanUpNoise(float * resultArray)
 
 
 
-//Multithreaded function to get a 2d texture that maps on a sphere
-float* GetSphereSurfaceNoiseSIMD(int width, int height, int octaves, float lacunarity, float frequency, float gain, float offset, int fractalType, int noiseType, float* __restrict outMin, float * __restrict outMax)
+bool SelectFractalSIMD(int fractalType, int octaves, ISIMDFractal3d* fractalFunction)
 {
-	//SIMD data has to be aligned
-	SIMD* result = (SIMD*)_aligned_malloc(width*height*  sizeof(float), MEMORY_ALIGNMENT);
-
-	ISIMDFractal3d fractalFunction;
-	ISIMDNoise3d noiseFunction;
-
 	switch ((FractalType)fractalType)
 	{
 	case FBM: 
 	{
-		if (octaves == 1) fractalFunction = plainSIMD3d;
-		else fractalFunction = fbmSIMD3d; 
+		if (octaves == 1) *fractalFunction = plainSIMD3d;
+		else *fractalFunction = fbmSIMD3d; 
 		break;
 	}
 	case TURBULENCE:
 	{
-		if (octaves == 1) fractalFunction = plainSIMD3d;
-		else fractalFunction = turbulenceSIMD3d; 
+		if (octaves == 1) *fractalFunction = plainSIMD3d;
+		else *fractalFunction = turbulenceSIMD3d; 
 		break;
 	}
 	case RIDGE: 
 	{
-		if (octaves == 1) fractalFunction = ridgePlainSIMD3d;
-		else fractalFunction = ridgeSIMD3d; 
+		if (octaves == 1) *fractalFunction = ridgePlainSIMD3d;
+		else *fractalFunction = ridgeSIMD3d; 
 		break;
 	}
-	case PLAIN: fractalFunction = plainSIMD3d; break;	
-	{		
-		fractalFunction = plainSIMD3d; break;
-	}
-	default:return 0;
+	case PLAIN: *fractalFunction = plainSIMD3d; break;
+	default: return false;
 	}
+	return true;
+}
 
+bool SelectNoiseSIMD(int noiseType, ISIMDNoise3d* noiseFunction, int quality)
+{
+	if (noiseType != PERLIN && noiseType != SIMPLEX) return false;
+	if (quality < QUALITY_REFERENCE || quality > QUALITY_FASTEST) return false;
+	if (noiseType == SIMPLEX) initSIMDSimplex();
+	*noiseFunction = SelectNoiseKernel(noiseType, CurrentKernelConfig()->gather != 0, quality);
+	return true;
+}
 
-	switch ((NoiseType)noiseType)
+bool SelectFractalSIMD(int fractalType, int octaves, ISIMDFractal3dN* fractalFunction)
+{
+	switch ((FractalType)fractalType)
 	{
-	case PERLIN:
-		noiseFunction = perlinSIMD3d;
-		break;
-	case SIMPLEX:
+	case FBM: *fractalFunction = octaves == 1 ? plainSIMD3dN : fbmSIMD3dN; break;
+	case TURBULENCE: *fractalFunction = octaves == 1 ? plainSIMD3dN : turbulenceSIMD3dN; break;
+	case RIDGE: *fractalFunction = octaves == 1 ? ridgePlainSIMD3dN : ridgeSIMD3dN; break;
+	case PLAIN: *fractalFunction = plainSIMD3dN; break;
+	default: return false;
+	}
+	return true;
+}
+
+bool SelectNoiseSIMD(int noiseType, ISIMDNoise3dN* noiseFunction, int quality)
+{
+	if (noiseType != PERLIN && noiseType != SIMPLEX) return false;
+	if (quality < QUALITY_REFERENCE || quality > QUALITY_FASTEST) return false;
+	if (noiseType == SIMPLEX) initSIMDSimplex();
+	const KernelConfig* config = CurrentKernelConfig();
+	*noiseFunction = SelectNoiseKernelN(noiseType, config->unroll, config->gather != 0, quality);
+	return true;
+}
+
+void SeedOffset(int seed, float* x, float* y, float* z)
+{
+	if (seed == 0)
 	{
-		initSIMDSimplex();
-		noiseFunction = simplexSIMD3d;
+		*x = *y = *z = 0;
+		return;
 	}
+	//spread the seed over three values in [0,64) with a small integer hash
+	uint32_t h = (uint32_t)seed;
+	float* out[3] = { x, y, z };
+	for (int i = 0; i < 3; i++)
+	{
+		h ^= h >> 16;
+		h *= 0x7feb352d;
+		h ^= h >> 15;
+		h *= 0x846ca68b;
+		h ^= h >> 16;
+		*out[i] = (h & 0xffff) * (64.0f / 65536.0f);
 	}
-	
-	float* __restrict xcos = new float[width];
-	float* __restrict ysin = new float[width];
+}
 
+#ifdef DETERMINISTIC
+//sin and cos built from basic double arithmetic only, so unlike the libm functions
+//they round the same with every compiler and C library. Error is below 1e-15
+//for the 0..2pi angles of a sphere map, far under float precision.
+static void sphereSinCos(float angle, float* s, float* c)
+{
+	//r in [-pi/4,pi/4] around the k-th multiple of pi/2, pi/2 split in two for precision
+	double k = floor(angle * 0.63661977236758134 + 0.5);
+	double r = (angle - k * 1.5707963267948966) - k * 6.123233995736766e-17;
+	double r2 = r*r;
+	double sn = r * (1 + r2*(-1 / 6.0 + r2*(1 / 120.0 + r2*(-1 / 5040.0 + r2*(1 / 362880.0 + r2*(-1 / 39916800.0 + r2*(1 / 6227020800.0 + r2*(-1 / 1307674368000.0))))))));
+	double cs = 1 + r2*(-1 / 2.0 + r2*(1 / 24.0 + r2*(-1 / 720.0 + r2*(1 / 40320.0 + r2*(-1 / 3628800.0 + r2*(1 / 479001600.0 + r2*(-1 / 87178291200.0)))))));
+	switch ((int)k & 3)
+	{
+	case 0: *s = (float)sn; *c = (float)cs; break;
+	case 1: *s = (float)cs; *c = (float)-sn; break;
+	case 2: *s = (float)-sn; *c = (float)-cs; break;
+	default: *s = (float)-cs; *c = (float)sn;
+	}
+}
+#endif
+#ifndef DETERMINISTIC
+static void sphereSinCos(float angle, float* s, float* c)
+{
+	*s = sinf(angle);
+	*c = cosf(angle);
+}
+#endif
 
-	static const float twoPiOverWidth = TWOPI / width;
-	static const float piOverHeight = PI / height;
-	float phi = 0;
-	float sinPhi;
-	int count = 0;
+void InitSphereTable(SphereTable* T, int width, int height, int seed)
+{
+	FIXED_FLOAT_STATE();
+	T->width = width;
+	T->height = height;
+	SeedOffset(seed, &T->originX, &T->originY, &T->originZ);
+	T->xcos = new float[width];
+	T->ysin = new float[width];
+
+	float twoPiOverWidth = TWOPI / width;
 	float theta = 0;
 	for (int x = 0; x < width; x = x + 1)
 	{
 		theta = theta + twoPiOverWidth;
-		xcos[x] = cosf(theta);
-		ysin[x] = sinf(theta);
+		sphereSinCos(theta, &T->ysin[x], &T->xcos[x]);
 	}
+}
 
-	Settings S;
-	initSIMD(&S, frequency, lacunarity, offset, gain, octaves);
-		
-	uSIMD min;
-	uSIMD max;
-	min.m = SetOne(999);
-	max.m = SetOne(-999);
-	//Platforms which have SIMD cos/sin can vectorize this
-	for (int y = 0; y < height; y = y + 1)
-	{
-		phi = phi + piOverHeight;
-		S.z.m = SetOne(cosf(phi));
-		sinPhi = sinf(phi);
+void FreeSphereTable(SphereTable* T)
+{
+	delete[] T->xcos;
+	delete[] T->ysin;
+	T->xcos = 0;
+	T->ysin = 0;
+}
+
+float SphereRowSIMD(Settings* S, const SphereTable* T, int y)
+{
+	//computed from the row index rather than accumulated so rows can be generated in any order
+	float phi = (y + 1) * (PI / T->height);
+	float sinPhi, cosPhi;
+	sphereSinCos(phi, &sinPhi, &cosPhi);
+	S->z.m = SetOne(cosPhi + T->originZ);
+	return sinPhi;
+}
 
-		for (int x = 0; x < width - (VECTOR_SIZE - 1); x = x + VECTOR_SIZE)
+void FillSphereRowSIMD(float* out, const SphereTable* T, int y, int x0, int x1, Settings* S, ISIMDFractal3dN fractalFunction, ISIMDNoise3dN noiseFunction, SIMD* min, SIMD* max)
+{
+	float sinPhi = SphereRowSIMD(S, T, y);
+	SIMD x[KERNEL_UNROLL], vy[KERNEL_UNROLL], z[KERNEL_UNROLL], r[KERNEL_UNROLL];
+	for (int u = 0; u < KERNEL_UNROLL; u++) z[u] = S->z.m;
+	//KERNEL_UNROLL vectors per kernel call, whole vectors past x1 just repeat the last column
+	for (int c = x0; c < x1; c = c + VECTOR_SIZE*KERNEL_UNROLL)
+	{
+		for (int u = 0; u < KERNEL_UNROLL; u++)
 		{
-			for (int j = 0; j < VECTOR_SIZE; j++)
-			{
-				S.x.a[j] = xcos[x + j] * sinPhi;
-				S.y.a[j] = ysin[x + j] * sinPhi;
-			}
-
-			fractalFunction(&result[count], &S, noiseFunction);
-		
-			min.m = Min(min.m, result[count]);
-			max.m = Max(max.m, result[count]);
-			count = count + 1;
+			SphereVectorSIMD(S, T, c + u*VECTOR_SIZE, x1, sinPhi);
+			x[u] = S->x.m;
+			vy[u] = S->y.m;
+		}
+		fractalFunction(r, x, vy, z, S, noiseFunction);
+		for (int u = 0; u < KERNEL_UNROLL; u++)
+		{
+			int count = x1 - (c + u*VECTOR_SIZE);
+			if (count <= 0) break;
+			*min = Min(*min, r[u]);
+			*max = Max(*max, r[u]);
+			StorePartial(out + (c + u*VECTOR_SIZE - x0), r[u], count < VECTOR_SIZE ? count : VECTOR_SIZE);
 		}
 	}
+}
 
+void ReduceMinMax(const SIMD* min, const SIMD* max, float* outMin, float* outMax)
+{
+	uSIMD umin, umax;
+	umin.m = *min;
+	umax.m = *max;
 	*outMin = 999;
 	*outMax = -999;
 	for (int i = 0; i < VECTOR_SIZE; i++)
 	{
-		*outMin = fminf(*outMin, min.a[i]);
-		*outMax = fmaxf(*outMax, max.a[i]);
+		*outMin = fminf(*outMin, umin.a[i]);
+		*outMax = fmaxf(*outMax, umax.a[i]);
 	}
-	
-	delete[] xcos;
-	delete[] ysin;
-	
-	return (float*)result;
+}
+
+
+void ReduceChunkMinMax(const float* chunkMin, const float* chunkMax, int chunks, float* outMin, float* outMax)
+{
+	*outMin = 999;
+	*outMax = -999;
+	for (int i = 0; i < chunks; i++)
+	{
+		*outMin = fminf(*outMin, chunkMin[i]);
+		*outMax = fmaxf(*outMax, chunkMax[i]);
+	}
+}
+
+struct SphereTileContext
+{
+	float* result;
+	const SphereTable* T;
+	const Settings* S;
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	int x0;
+	int y0;
+	int tileWidth;
+	float* chunkMin;
+	float* chunkMax;
+	NoiseSummary* summary; //null when only min/max are wanted
+	double* rowSum;
+	double* rowSquares;
+	SummaryThreads* histograms;
+};
+
+static void sphereTileChunk(void* context, int begin, int end, int chunk)
+{
+	SphereTileContext* C = (SphereTileContext*)context;
+	Settings S = *C->S;
+	SIMD min = SetOne(999);
+	SIMD max = SetOne(-999);
+	SummaryPartial partial;
+	if (C->summary) BeginSummaryPartial(&partial, C->summary, C->histograms);
+	for (int y = begin; y < end; y = y + 1)
+	{
+		float* row = C->result + (size_t)y*C->tileWidth;
+		FillSphereRowSIMD(row, C->T, C->y0 + y, C->x0, C->x0 + C->tileWidth, &S, C->fractalFunction, C->noiseFunction, &min, &max);
+		if (C->summary) SummarizeRow(&partial, C->summary, row, C->tileWidth, &C->rowSum[y], &C->rowSquares[y]);
+	}
+	ReduceMinMax(&min, &max, &C->chunkMin[chunk], &C->chunkMax[chunk]);
+	if (C->summary) EndSummaryPartial(&partial, C->summary, C->histograms);
+}
+
+//Shared by both tile functions, summary is null for min/max only
+static bool fillSphereTile(float* result, const NoiseParams* P, int width, int height, int x0, int y0, int tileWidth, int tileHeight, float* __restrict outMin, float* __restrict outMax, NoiseSummary* summary)
+{
+	STATS_BEGIN(setup);
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	if (!SelectFractalSIMD(P->fractalType, P->octaves, &fractalFunction)) return false;
+	if (!SelectNoiseSIMD(P->noiseType, &noiseFunction, P->quality)) return false;
+	if (x0 < 0 || y0 < 0 || tileWidth < 1 || tileHeight < 1 || x0 + tileWidth > width || y0 + tileHeight > height) return false;
+
+	SphereTable T;
+	InitSphereTable(&T, width, height, P->seed);
+
+	Settings S;
+	initSIMD(&S, P->frequency, P->lacunarity, P->offset, P->gain, P->octaves);
+
+	int grain = GetSchedulerGrain();
+	int chunks = ChunkCount(tileHeight, grain);
+	SummaryThreads histograms;
+	if (summary) BeginSummaryThreads(&histograms, summary);
+	SphereTileContext C = { result, &T, &S, fractalFunction, noiseFunction, x0, y0, tileWidth, new float[chunks], new float[chunks],
+		summary, summary ? new double[tileHeight] : 0, summary ? new double[tileHeight] : 0, &histograms };
+	STATS_END(setup, PHASE_SETUP);
+
+	STATS_BEGIN(kernel);
+	ParallelFor(tileHeight, grain, sphereTileChunk, &C);
+	STATS_END(kernel, PHASE_KERNEL);
+	STATS_COUNT((uint64_t)tileWidth*tileHeight, P->fractalType == PLAIN ? 1 : P->octaves);
+
+	STATS_BEGIN(reduction);
+	ReduceChunkMinMax(C.chunkMin, C.chunkMax, chunks, outMin, outMax);
+	delete[] C.chunkMin;
+	delete[] C.chunkMax;
+	if (summary)
+	{
+		summary->count = (uint64_t)tileWidth*tileHeight;
+		AddSummaryRows(summary, C.rowSum, C.rowSquares, tileHeight);
+		delete[] C.rowSum;
+		delete[] C.rowSquares;
+		EndSummaryThreads(&histograms, summary);
+	}
+	FreeSphereTable(&T);
+	STATS_END(reduction, PHASE_REDUCTION);
+	return true;
+}
+
+//Evaluates the tileWidth x tileHeight region at x0,y0 of a width x height
+//sphere map into result, rows packed tileWidth apart
+bool FillSphereSurfaceTileSIMD(float* result, const NoiseParams* P, int width, int height, int x0, int y0, int tileWidth, int tileHeight, float* __restrict outMin, float* __restrict outMax)
+{
+	return fillSphereTile(result, P, width, height, x0, y0, tileWidth, tileHeight, outMin, outMax, 0);
+}
+
+//Same, also filling in summary
+bool FillSphereSurfaceTileSummarySIMD(float* result, const NoiseParams* P, int width, int height, int x0, int y0, int tileWidth, int tileHeight, NoiseSummary* summary)
+{
+	if (!BeginSummary(summary)) return false;
+	return fillSphereTile(result, P, width, height, x0, y0, tileWidth, tileHeight, &summary->min, &summary->max, summary);
+}
+
+//Multithreaded function to get a 2d texture that maps on a sphere
+float* GetSphereSurfaceNoiseSIMD(int width, int height, int octaves, float lacunarity, float frequency, float gain, float offset, int fractalType, int noiseType, float* __restrict outMin, float * __restrict outMax)
+{
+	NoiseParams P = { octaves, lacunarity, frequency, gain, offset, fractalType, noiseType, 0, QUALITY_REFERENCE };
 
+	//SIMD data has to be aligned
+	STATS_BEGIN(allocation);
+	float* result = (float*)_aligned_malloc(width*height*  sizeof(float), MEMORY_ALIGNMENT);
+	STATS_END(allocation, PHASE_ALLOCATION);
+	if (!FillSphereSurfaceTileSIMD(result, &P, width, height, 0, 0, width, height, outMin, outMax))
+	{
+		_aligned_free(result);
+		return 0;
+	}
+	return result;
 }
 
 float* GetSphereSurfaceNoise(int width, int height, int octaves, float lacunarity, float frequency, float gain, float offset, int fractalType, int noiseType, float *outMin, float *outMax)
@@ -159,8 +362,8 @@ float* GetSphereSurfaceNoise(int width, int height, int octaves, float lacunarit
 
 	//set up spherical stuff
 	int count = 0;
-	static const float piOverHeight = PI / (height + 1);
-	static const float twoPiOverWidth = TWOPI / width;
+	float piOverHeight = PI / (height + 1);
+	float twoPiOverWidth = TWOPI / width;
 	float phi = 0;
 	float x3d, y3d, z3d;
 	float sinPhi, theta;
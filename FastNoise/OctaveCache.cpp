@@ -0,0 +1,158 @@
+#include "headers\OctaveCache.h"
+#include "headers\TileScheduler.h"
+
+#if defined(F16C) && !defined(DETERMINISTIC)
+#define StoreLayer(x,y) StoreHalf(x,y)
+#define LoadLayer(x) LoadHalf(x)
+#endif
+#if !defined(F16C) || defined(DETERMINISTIC)
+#define StoreLayer(x,y) Store(x,y)
+#define LoadLayer(x) Load(x)
+#endif
+
+
+//Must be called by the caller of GetSphereSurfaceOctaveLayersSIMD
+void CleanUpOctaveLayers(OctaveLayerCache* cache)
+{
+	if (!cache) return;
+	_aligned_free(cache->layers);
+	delete cache;
+}
+
+
+struct LayerContext
+{
+	OctaveLayerCache* cache;
+	const SphereTable* T;
+	const Settings* S;
+	ISIMDNoise3d noiseFunction;
+};
+
+static void layerChunk(void* context, int begin, int end, int)
+{
+	LayerContext* C = (LayerContext*)context;
+	OctaveLayerCache* cache = C->cache;
+	Settings S = *C->S;
+	OctaveSample* layer = cache->layers + (size_t)begin*cache->blocks*cache->octaves*VECTOR_SIZE;
+	for (int y = begin; y < end; y = y + 1)
+	{
+		float sinPhi = SphereRowSIMD(&S, C->T, y);
+		for (int x = 0; x < cache->width; x = x + VECTOR_SIZE)
+		{
+			SphereVectorSIMD(&S, C->T, x, cache->width, sinPhi);
+			//same frequency sequence as the fractal functions so the layers match them exactly
+			SIMD localFrequency = S.frequency;
+			for (int i = cache->octaves; i != 0; i--)
+			{
+				SIMD vfx = Mul(S.x.m, localFrequency);
+				SIMD vfy = Mul(S.y.m, localFrequency);
+				SIMD vfz = Mul(S.z.m, localFrequency);
+				StoreLayer(layer, C->noiseFunction(&vfx, &vfy, &vfz));
+				layer += VECTOR_SIZE;
+				localFrequency = Mul(localFrequency, S.lacunarity);
+			}
+		}
+	}
+}
+
+//Evaluates and stores the raw noise of every octave of a sphere map,
+//using the same coordinates and frequencies as GetSphereSurfaceNoiseSIMD
+OctaveLayerCache* GetSphereSurfaceOctaveLayersSIMD(int width, int height, int octaves, float lacunarity, float frequency, int noiseType)
+{
+	ISIMDNoise3d noiseFunction;
+	if (octaves < 1) return 0;
+	if (!SelectNoiseSIMD(noiseType, &noiseFunction)) return 0;
+
+	OctaveLayerCache* cache = new OctaveLayerCache;
+	cache->width = width;
+	cache->height = height;
+	cache->octaves = octaves;
+	cache->blocks = (width + VECTOR_SIZE - 1) / VECTOR_SIZE;
+	cache->frequency = frequency;
+	cache->lacunarity = lacunarity;
+	cache->noiseType = noiseType;
+	cache->layers = (OctaveSample*)_aligned_malloc((size_t)cache->blocks*height*octaves*VECTOR_SIZE*sizeof(OctaveSample), MEMORY_ALIGNMENT);
+
+	SphereTable T;
+	InitSphereTable(&T, width, height);
+
+	Settings S;
+	initSIMD(&S, frequency, lacunarity, 0, 0, octaves);
+
+	LayerContext C = { cache, &T, &S, noiseFunction };
+	ParallelFor(height, 0, layerChunk, &C);
+
+	FreeSphereTable(&T);
+	return cache;
+}
+
+
+struct CombineContext
+{
+	const OctaveLayerCache* cache;
+	float* result;
+	int octaves;
+	int fractalType;
+	float gain;
+	float offset;
+	float* chunkMin;
+	float* chunkMax;
+};
+
+static void combineChunk(void* context, int begin, int end, int chunk)
+{
+	CombineContext* C = (CombineContext*)context;
+	const OctaveLayerCache* cache = C->cache;
+	int width = cache->width;
+	SIMD vgain = SetOne(C->gain);
+	SIMD voffset = SetOne(C->offset);
+	SIMD min = SetOne(999);
+	SIMD max = SetOne(-999);
+	for (int y = begin; y < end; y = y + 1)
+	{
+		const OctaveSample* layer = cache->layers + (size_t)y*cache->blocks*cache->octaves*VECTOR_SIZE;
+		for (int x = 0; x < width; x = x + VECTOR_SIZE)
+		{
+			FractalAccumulator A;
+			BeginFractal(&A, C->fractalType, C->octaves);
+			for (int i = 0; i < C->octaves; i++)
+			{
+				AddOctave(&A, LoadLayer(layer + i*VECTOR_SIZE), vgain, voffset);
+			}
+			SIMD out = A.out;
+			layer += cache->octaves*VECTOR_SIZE;
+
+			min = Min(min, out);
+			max = Max(max, out);
+			int count = width - x < VECTOR_SIZE ? width - x : VECTOR_SIZE;
+			StorePartial(C->result + (size_t)y*width + x, out, count);
+		}
+	}
+	ReduceMinMax(&min, &max, &C->chunkMin[chunk], &C->chunkMax[chunk]);
+}
+
+//Recombines the first octaves layers into a fractal with a new gain/offset.
+//Single octave requests map to the same functions GetSphereSurfaceNoiseSIMD uses.
+float* CombineOctaveLayersSIMD(const OctaveLayerCache* cache, int octaves, float gain, float offset, int fractalType, float* __restrict outMin, float* __restrict outMax)
+{
+	if (!cache || octaves < 1 || octaves > cache->octaves) return 0;
+	if (fractalType == PLAIN) octaves = 1;
+
+	switch ((FractalType)fractalType)
+	{
+	case FBM: case TURBULENCE: case RIDGE: case PLAIN: break;
+	default: return 0;
+	}
+
+	float* result = (float*)_aligned_malloc((size_t)cache->width*cache->height*sizeof(float), MEMORY_ALIGNMENT);
+
+	int grain = GetSchedulerGrain();
+	int chunks = ChunkCount(cache->height, grain);
+	CombineContext C = { cache, result, octaves, fractalType, gain, offset, new float[chunks], new float[chunks] };
+	ParallelFor(cache->height, grain, combineChunk, &C);
+
+	ReduceChunkMinMax(C.chunkMin, C.chunkMax, chunks, outMin, outMax);
+	delete[] C.chunkMin;
+	delete[] C.chunkMax;
+	return result;
+}
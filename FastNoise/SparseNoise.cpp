@@ -0,0 +1,309 @@
+#include "headers\SparseNoise.h"
+#include "headers\TileScheduler.h"
+#include "headers\NoiseStats.h"
+#include <string.h>
+#include <math.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//Active samples are packed into whole kernel calls regardless of where they are in the
+//map, so the cost follows the number of active samples instead of the map size
+#define SPARSE_BATCH (VECTOR_SIZE*KERNEL_UNROLL)
+
+struct SparseContext
+{
+	float* result;
+	const SphereTable* T;
+	const Settings* S;
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	const float* rowSin; //sin(phi) of every row
+	const float* rowZ; //z coordinate of every row
+	const uint32_t* mask;
+	const int* indices;
+	float* chunkMin;
+	float* chunkMax;
+	int stride; //progressive levels: this level's and the previous level's stride (0 for the first)
+	int previousStride;
+	int fillStride; //when above 1 every sample is also copied over the stride x stride block it stands for
+};
+
+//Coordinates and destinations of up to SPARSE_BATCH compacted samples
+struct SparseBatch
+{
+	uSIMD x[KERNEL_UNROLL];
+	uSIMD y[KERNEL_UNROLL];
+	uSIMD z[KERNEL_UNROLL];
+	int index[SPARSE_BATCH];
+	int lanes;
+	SIMD min;
+	SIMD max;
+};
+
+static inline int lowestBit(uint32_t bits)
+{
+#ifdef _MSC_VER
+	unsigned long b;
+	_BitScanForward(&b, bits);
+	return (int)b;
+#endif
+#ifndef _MSC_VER
+	return __builtin_ctz(bits);
+#endif
+}
+
+static void flushBatch(SparseBatch* B, const SparseContext* C)
+{
+	if (B->lanes == 0) return;
+	float* x = (float*)B->x;
+	float* y = (float*)B->y;
+	float* z = (float*)B->z;
+	//unused lanes repeat the last sample so they never disturb min/max
+	for (int i = B->lanes; i < SPARSE_BATCH; i++)
+	{
+		x[i] = x[B->lanes - 1];
+		y[i] = y[B->lanes - 1];
+		z[i] = z[B->lanes - 1];
+	}
+	SIMD vx[KERNEL_UNROLL], vy[KERNEL_UNROLL], vz[KERNEL_UNROLL];
+	uSIMD r[KERNEL_UNROLL];
+	for (int u = 0; u < KERNEL_UNROLL; u++)
+	{
+		vx[u] = B->x[u].m;
+		vy[u] = B->y[u].m;
+		vz[u] = B->z[u].m;
+	}
+	C->fractalFunction(&r[0].m, vx, vy, vz, C->S, C->noiseFunction);
+	for (int u = 0; u < KERNEL_UNROLL; u++)
+	{
+		B->min = Min(B->min, r[u].m);
+		B->max = Max(B->max, r[u].m);
+	}
+	//no scatter store below AVX-512, the lanes go back one by one
+	const float* values = (const float*)r;
+	for (int i = 0; i < B->lanes; i++) C->result[B->index[i]] = values[i];
+	if (C->fillStride > 1)
+	{
+		//the block holds no sample of this or a coarser level besides its own corner
+		int width = C->T->width;
+		int height = C->T->height;
+		for (int i = 0; i < B->lanes; i++)
+		{
+			int row = B->index[i] / width;
+			int column = B->index[i] - row*width;
+			int rowEnd = row + C->fillStride < height ? row + C->fillStride : height;
+			int columnEnd = column + C->fillStride < width ? column + C->fillStride : width;
+			for (int y = row; y < rowEnd; y++)
+			{
+				float* out = C->result + (size_t)y*width;
+				for (int x = column; x < columnEnd; x++) out[x] = values[i];
+			}
+		}
+	}
+	B->lanes = 0;
+}
+
+static inline void addSample(SparseBatch* B, const SparseContext* C, int index)
+{
+	const SphereTable* T = C->T;
+	int row = index / T->width;
+	int column = index - row*T->width;
+	int lane = B->lanes;
+	//same arithmetic as SphereVectorSIMD, so a sample matches the dense map bit for bit
+	((float*)B->x)[lane] = T->xcos[column] * C->rowSin[row] + T->originX;
+	((float*)B->y)[lane] = T->ysin[column] * C->rowSin[row] + T->originY;
+	((float*)B->z)[lane] = C->rowZ[row];
+	B->index[lane] = index;
+	if (++B->lanes == SPARSE_BATCH) flushBatch(B, C);
+}
+
+static void maskedChunk(void* context, int begin, int end, int chunk)
+{
+	SparseContext* C = (SparseContext*)context;
+	SparseBatch B;
+	B.lanes = 0;
+	B.min = SetOne(999);
+	B.max = SetOne(-999);
+	//walk the set bits of samples begin..end-1, clearing the bits outside the range
+	for (int w = begin / 32; w * 32 < end; w++)
+	{
+		uint32_t bits = C->mask[w];
+		if (w * 32 < begin) bits &= ~0u << (begin - w * 32);
+		if (w * 32 + 32 > end) bits &= ~0u >> (w * 32 + 32 - end);
+		while (bits)
+		{
+			addSample(&B, C, w * 32 + lowestBit(bits));
+			bits &= bits - 1;
+		}
+	}
+	flushBatch(&B, C);
+	ReduceMinMax(&B.min, &B.max, &C->chunkMin[chunk], &C->chunkMax[chunk]);
+}
+
+static void indexedChunk(void* context, int begin, int end, int chunk)
+{
+	SparseContext* C = (SparseContext*)context;
+	SparseBatch B;
+	B.lanes = 0;
+	B.min = SetOne(999);
+	B.max = SetOne(-999);
+	for (int i = begin; i < end; i++) addSample(&B, C, C->indices[i]);
+	flushBatch(&B, C);
+	ReduceMinMax(&B.min, &B.max, &C->chunkMin[chunk], &C->chunkMax[chunk]);
+}
+
+//Kernels, sphere table and row coordinates of every entry point
+static bool beginSparse(SparseContext* C, SphereTable* T, Settings* S, float* result, const NoiseParams* P, int width, int height)
+{
+	FIXED_FLOAT_STATE();
+	memset(C, 0, sizeof(*C));
+	if (!SelectFractalSIMD(P->fractalType, P->octaves, &C->fractalFunction)) return false;
+	if (!SelectNoiseSIMD(P->noiseType, &C->noiseFunction, P->quality)) return false;
+	InitSphereTable(T, width, height, P->seed);
+	initSIMD(S, P->frequency, P->lacunarity, P->offset, P->gain, P->octaves);
+	float* rowSin = new float[2 * height];
+	float* rowZ = rowSin + height;
+	Settings row;
+	for (int y = 0; y < height; y++)
+	{
+		rowSin[y] = SphereRowSIMD(&row, T, y);
+		rowZ[y] = row.z.a[0];
+	}
+	C->result = result;
+	C->T = T;
+	C->S = S;
+	C->rowSin = rowSin;
+	C->rowZ = rowZ;
+	return true;
+}
+
+static void endSparse(SparseContext* C, SphereTable* T)
+{
+	delete[] C->rowSin;
+	FreeSphereTable(T);
+}
+
+//Shared by both entry points, count is the number of samples (masked) or indices
+static bool fillSparse(float* result, const NoiseParams* P, int width, int height, const uint32_t* mask, const int* indices, int count, ChunkTask task, float* outMin, float* outMax)
+{
+	STATS_BEGIN(setup);
+	SparseContext C;
+	SphereTable T;
+	Settings S;
+	if (!beginSparse(&C, &T, &S, result, P, width, height)) return false;
+	if (count == 0)
+	{
+		endSparse(&C, &T);
+		*outMin = 999;
+		*outMax = -999;
+		return true;
+	}
+	C.mask = mask;
+	C.indices = indices;
+
+	//a chunk spans as many samples as grain dense rows would
+	int span = GetSchedulerGrain()*width;
+	int chunks = ChunkCount(count, span);
+	C.chunkMin = new float[chunks];
+	C.chunkMax = new float[chunks];
+	STATS_END(setup, PHASE_SETUP);
+
+	STATS_BEGIN(kernel);
+	ParallelFor(count, span, task, &C);
+	STATS_END(kernel, PHASE_KERNEL);
+
+	STATS_BEGIN(reduction);
+	ReduceChunkMinMax(C.chunkMin, C.chunkMax, chunks, outMin, outMax);
+	delete[] C.chunkMin;
+	delete[] C.chunkMax;
+	endSparse(&C, &T);
+	STATS_END(reduction, PHASE_REDUCTION);
+	return true;
+}
+
+bool FillSphereSurfaceMaskedSIMD(float* result, const NoiseParams* P, int width, int height, const uint32_t* mask, float* outMin, float* outMax)
+{
+	if (width < 1 || height < 1) return false;
+	return fillSparse(result, P, width, height, mask, 0, width*height, maskedChunk, outMin, outMax);
+}
+
+bool FillSphereSurfaceIndexedSIMD(float* result, const NoiseParams* P, int width, int height, const int* indices, int count, float* outMin, float* outMax)
+{
+	if (width < 1 || height < 1 || count < 0) return false;
+	for (int i = 0; i < count; i++)
+	{
+		if (indices[i] < 0 || indices[i] >= width*height) return false;
+	}
+	return fillSparse(result, P, width, height, 0, indices, count, indexedChunk, outMin, outMax);
+}
+
+//Rows begin..end-1 of a level, the row of a level is every stride-th row of the map
+static void progressiveChunk(void* context, int begin, int end, int chunk)
+{
+	SparseContext* C = (SparseContext*)context;
+	SparseBatch B;
+	B.lanes = 0;
+	B.min = SetOne(999);
+	B.max = SetOne(-999);
+	int width = C->T->width;
+	for (int r = begin; r < end; r++)
+	{
+		int y = r*C->stride;
+		//rows of the previous level already have every other column
+		int x0 = 0;
+		int step = C->stride;
+		if (C->previousStride && y % C->previousStride == 0)
+		{
+			x0 = C->stride;
+			step = C->previousStride;
+		}
+		for (int x = x0; x < width; x += step) addSample(&B, C, y*width + x);
+	}
+	flushBatch(&B, C);
+	ReduceMinMax(&B.min, &B.max, &C->chunkMin[chunk], &C->chunkMax[chunk]);
+}
+
+bool FillSphereSurfaceProgressiveSIMD(float* result, const NoiseParams* P, int width, int height, int firstStride, bool fillGaps, NoiseProgressCallback callback, void* userData, float* outMin, float* outMax)
+{
+	if (width < 1 || height < 1 || firstStride < 1 || (firstStride & (firstStride - 1)) != 0) return false;
+	SparseContext C;
+	SphereTable T;
+	Settings S;
+	if (!beginSparse(&C, &T, &S, result, P, width, height)) return false;
+	//no level has more chunks than the full resolution one
+	int grain = GetSchedulerGrain();
+	int chunks = ChunkCount(height, grain);
+	C.chunkMin = new float[chunks];
+	C.chunkMax = new float[chunks];
+
+	float min = 999;
+	float max = -999;
+	bool finished = true;
+	for (int stride = firstStride; stride >= 1; stride /= 2)
+	{
+		C.stride = stride;
+		C.previousStride = stride == firstStride ? 0 : 2 * stride;
+		C.fillStride = fillGaps ? stride : 0;
+		//level rows carry fewer samples, so more of them go to a chunk
+		int levelRows = (height + stride - 1) / stride;
+		int levelGrain = grain*stride;
+		int levelChunks = ChunkCount(levelRows, levelGrain);
+		ParallelFor(levelRows, levelGrain, progressiveChunk, &C);
+		float levelMin, levelMax;
+		ReduceChunkMinMax(C.chunkMin, C.chunkMax, levelChunks, &levelMin, &levelMax);
+		min = fminf(min, levelMin);
+		max = fmaxf(max, levelMax);
+		if (callback && !callback(result, stride, min, max, userData) && stride > 1)
+		{
+			finished = false;
+			break;
+		}
+	}
+	*outMin = min;
+	*outMax = max;
+	delete[] C.chunkMin;
+	delete[] C.chunkMax;
+	endSparse(&C, &T);
+	return finished;
+}
@@ -0,0 +1,350 @@
+#include "headers\TileScheduler.h"
+#include "headers\NoiseStats.h"
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//Every worker owns a deque of chunks. It takes work from the back of its own
+//deque and, once that is empty, steals from the front of the others, so
+//batches of uneven chunks keep every worker busy without a central queue.
+
+struct Batch
+{
+	ChunkTask task;
+	void* context;
+	BatchDone done;
+	int grain;
+	std::atomic<int> remaining;
+	//ParallelFor sleeps on these once none of its chunks are left to take
+	std::mutex lock;
+	std::condition_variable finished;
+	bool complete;
+};
+
+struct Chunk
+{
+	Batch* batch;
+	int begin;
+	int end;
+};
+
+struct WorkerQueue
+{
+	std::mutex lock;
+	std::deque<Chunk> chunks;
+};
+
+class Scheduler
+{
+public:
+	Scheduler() : started(false), stopping(false), pending(0), threads(0), pin(false), grain(DEFAULT_GRAIN), next(0) {}
+	~Scheduler() { stop(); }
+
+	void submit(int count, int grain, ChunkTask task, void* context, BatchDone done, Batch* batch);
+	bool runOne(int self);
+	bool runOwn(int self, const Batch* batch, const void* context);
+	void stop();
+
+	std::atomic<bool> started;
+	bool stopping;
+	std::atomic<int> pending; //chunks queued and not yet taken
+	int threads;
+	bool pin;
+	std::atomic<int> grain; //SetKernelConfig may change it while generators read it
+	std::mutex startLock;
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::vector<WorkerQueue*> queues;
+	std::vector<std::thread> workers;
+	std::atomic<unsigned> next;
+
+private:
+	void start();
+	void work(int self);
+	bool take(int self, Chunk* chunk);
+	bool takeOwn(int self, Chunk* chunk, const Batch* batch, const void* context);
+};
+
+static Scheduler scheduler;
+static thread_local int currentWorker = -1;
+
+
+int ChunkCount(int count, int grain)
+{
+	return (count + grain - 1) / grain;
+}
+
+int SchedulerWorkerIndex()
+{
+	return currentWorker;
+}
+
+void SetSchedulerThreads(int threads)
+{
+	std::lock_guard<std::mutex> guard(scheduler.startLock);
+	scheduler.threads = threads;
+}
+
+int GetSchedulerThreads()
+{
+	std::lock_guard<std::mutex> guard(scheduler.startLock);
+	if (scheduler.started) return (int)scheduler.workers.size();
+	if (scheduler.threads > 0) return scheduler.threads;
+	int count = (int)std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+void RestartScheduler()
+{
+	std::lock_guard<std::mutex> guard(scheduler.startLock);
+	if (!scheduler.started) return;
+	scheduler.stop();
+	{
+		std::lock_guard<std::mutex> sleepGuard(scheduler.sleepLock);
+		scheduler.stopping = false;
+	}
+	scheduler.started = false;
+}
+
+void SetSchedulerGrain(int rows)
+{
+	scheduler.grain = rows > 0 ? rows : DEFAULT_GRAIN;
+}
+
+int GetSchedulerGrain()
+{
+	return scheduler.grain;
+}
+
+void SetSchedulerAffinity(bool pin)
+{
+	std::lock_guard<std::mutex> guard(scheduler.startLock);
+	scheduler.pin = pin;
+}
+
+static void pinThread(std::thread& thread, int index)
+{
+	int cpus = (int)std::thread::hardware_concurrency();
+	if (cpus <= 0) return;
+#ifdef _WIN32
+	SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR)1 << (index % cpus));
+#endif
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(index % cpus, &set);
+	pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#endif
+}
+
+void Scheduler::start()
+{
+	std::lock_guard<std::mutex> guard(startLock);
+	if (started) return;
+	int count = threads;
+	if (count <= 0) count = (int)std::thread::hardware_concurrency();
+	if (count <= 0) count = 1;
+	for (int i = 0; i < count; i++) queues.push_back(new WorkerQueue);
+	for (int i = 0; i < count; i++)
+	{
+		workers.push_back(std::thread(&Scheduler::work, this, i));
+		if (pin) pinThread(workers.back(), i);
+	}
+	started = true;
+}
+
+void Scheduler::stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+	for (size_t i = 0; i < queues.size(); i++) delete queues[i];
+	workers.clear();
+	queues.clear();
+}
+
+//Workers only: own deque from the back first, then steal from the front of the others
+bool Scheduler::take(int self, Chunk* chunk)
+{
+	int count = (int)queues.size();
+	{
+		WorkerQueue* q = queues[self];
+		std::lock_guard<std::mutex> guard(q->lock);
+		if (!q->chunks.empty())
+		{
+			*chunk = q->chunks.back();
+			q->chunks.pop_back();
+			pending--;
+			return true;
+		}
+	}
+	for (int i = 1; i < count; i++)
+	{
+		WorkerQueue* q = queues[(self + i) % count];
+		std::lock_guard<std::mutex> guard(q->lock);
+		if (!q->chunks.empty())
+		{
+			*chunk = q->chunks.front();
+			q->chunks.pop_front();
+			pending--;
+			return true;
+		}
+	}
+	return false;
+}
+
+//A queued chunk of that batch (or of any batch with that context), so a waiting
+//caller only ever runs its own work. Own deque first, where nested work goes.
+bool Scheduler::takeOwn(int self, Chunk* chunk, const Batch* batch, const void* context)
+{
+	int count = (int)queues.size();
+	int first = self >= 0 ? self : 0;
+	for (int i = 0; i < count; i++)
+	{
+		WorkerQueue* q = queues[(first + i) % count];
+		std::lock_guard<std::mutex> guard(q->lock);
+		for (std::deque<Chunk>::iterator it = q->chunks.end(); it != q->chunks.begin();)
+		{
+			--it;
+			if (batch ? it->batch != batch : it->batch->context != context) continue;
+			*chunk = *it;
+			q->chunks.erase(it);
+			pending--;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void runChunk(const Chunk& chunk)
+{
+	Batch* batch = chunk.batch;
+	FIXED_FLOAT_STATE();
+	STATS_COUNTERS_BEGIN();
+	batch->task(batch->context, chunk.begin, chunk.end, chunk.begin / batch->grain);
+	STATS_COUNTERS_END();
+	//a waiting ParallelFor may return as soon as remaining hits 0, read the batch before that
+	BatchDone done = batch->done;
+	void* context = batch->context;
+	if (--batch->remaining != 0) return;
+	if (done)
+	{
+		delete batch;
+		done(context);
+		return;
+	}
+	//the waiter returns once complete is set, the batch is gone after the unlock
+	std::lock_guard<std::mutex> guard(batch->lock);
+	batch->complete = true;
+	batch->finished.notify_all();
+}
+
+bool Scheduler::runOne(int self)
+{
+	Chunk chunk;
+	if (!take(self, &chunk)) return false;
+	runChunk(chunk);
+	return true;
+}
+
+bool Scheduler::runOwn(int self, const Batch* batch, const void* context)
+{
+	if (!started) return false;
+	Chunk chunk;
+	if (!takeOwn(self, &chunk, batch, context)) return false;
+	runChunk(chunk);
+	return true;
+}
+
+void Scheduler::work(int self)
+{
+	currentWorker = self;
+	for (;;)
+	{
+		if (runOne(self)) continue;
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wake.wait(guard, [this] { return stopping || pending > 0; });
+		if (stopping) return;
+	}
+}
+
+//Chunks are dealt round robin so every worker starts with a share, a worker
+//submitting nested work keeps it on its own deque
+void Scheduler::submit(int count, int grain, ChunkTask task, void* context, BatchDone done, Batch* batch)
+{
+	start();
+	batch->task = task;
+	batch->context = context;
+	batch->done = done;
+	batch->grain = grain;
+	batch->complete = false;
+	int chunks = ChunkCount(count, grain);
+	batch->remaining = chunks;
+
+	int workerCount = (int)queues.size();
+	unsigned first = next++;
+	for (int c = 0; c < chunks; c++)
+	{
+		Chunk chunk = { batch, c*grain, (c + 1)*grain < count ? (c + 1)*grain : count };
+		int target = currentWorker >= 0 ? currentWorker : (int)((first + c) % workerCount);
+		WorkerQueue* q = queues[target];
+		std::lock_guard<std::mutex> guard(q->lock);
+		q->chunks.push_back(chunk);
+		pending++;
+	}
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+	}
+	wake.notify_all();
+}
+
+
+void ParallelFor(int count, int grain, ChunkTask task, void* context)
+{
+	if (count <= 0) return;
+	if (grain <= 0) grain = scheduler.grain;
+	if (count <= grain)
+	{
+		FIXED_FLOAT_STATE();
+		STATS_COUNTERS_BEGIN();
+		task(context, 0, count, 0);
+		STATS_COUNTERS_END();
+		return;
+	}
+	Batch batch;
+	scheduler.submit(count, grain, task, context, 0, &batch);
+	//run our own chunks instead of blocking, this also keeps nested calls from
+	//deadlocking, then sleep until the ones other threads took are done
+	while (scheduler.runOwn(currentWorker, &batch, 0)) {}
+	std::unique_lock<std::mutex> guard(batch.lock);
+	batch.finished.wait(guard, [&batch] { return batch.complete; });
+}
+
+bool RunQueuedChunk(const void* context)
+{
+	return scheduler.runOwn(currentWorker, 0, context);
+}
+
+void SubmitParallelFor(int count, int grain, ChunkTask task, void* context, BatchDone done)
+{
+	if (grain <= 0) grain = scheduler.grain;
+	if (count <= 0)
+	{
+		if (done) done(context);
+		return;
+	}
+	scheduler.submit(count, grain, task, context, done, new Batch);
+}
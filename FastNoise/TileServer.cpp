@@ -0,0 +1,459 @@
+#include "headers\TileServer.h"
+#ifdef __linux__
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <list>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+//A generated tile, the server keeps the segment open until it is evicted. Clients
+//that still have it mapped keep the memory alive after that.
+struct ServedTile
+{
+	NoiseCacheKey key;
+	uint64_t hash;
+	int fd;
+	size_t bytes;
+	float min;
+	float max;
+	std::list<ServedTile*>::iterator lru;
+};
+
+struct TileServer
+{
+	int listener;
+	int wake[2]; //written by StopTileServer to end the poll loop
+	size_t budget;
+	size_t bytes;
+	std::unordered_multimap<uint64_t, ServedTile*> tiles;
+	std::list<ServedTile*> lru; //most recently used first
+	std::thread thread;
+	char path[sizeof(((sockaddr_un*)0)->sun_path)];
+};
+
+struct TileClient
+{
+	int socket;
+};
+
+//A connected client and the part of its next request received so far. Client sockets
+//are non blocking, so a client that stops halfway through a request holds up nobody.
+struct TileConnection
+{
+	int socket;
+	size_t received;
+	TileServerRequest request;
+};
+
+static bool unixAddress(sockaddr_un* address, const char* path)
+{
+	if (strlen(path) >= sizeof(address->sun_path)) return false;
+	memset(address, 0, sizeof(*address));
+	address->sun_family = AF_UNIX;
+	strcpy(address->sun_path, path);
+	return true;
+}
+
+static bool sendAll(int socket, const void* data, size_t size)
+{
+	const char* p = (const char*)data;
+	while (size > 0)
+	{
+		ssize_t n = send(socket, p, size, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+static void removeTile(TileServer* S, ServedTile* t)
+{
+	auto range = S->tiles.equal_range(t->hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second == t)
+		{
+			S->tiles.erase(it);
+			break;
+		}
+	}
+	S->lru.erase(t->lru);
+	S->bytes -= t->bytes;
+	close(t->fd);
+	delete t;
+}
+
+//Generates straight into a sealed memfd segment
+static ServedTile* generateTile(const NoiseCacheKey* key)
+{
+	size_t bytes = (size_t)key->tileWidth*key->tileHeight*sizeof(float);
+	int fd = memfd_create("fastnoise tile", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) return 0;
+	float* data = 0;
+	if (ftruncate(fd, bytes) == 0)
+	{
+		void* p = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED) data = (float*)p;
+	}
+	float min, max;
+	bool ok = data && FillSphereSurfaceTileSIMD(data, &key->params, key->width, key->height, key->x0, key->y0, key->tileWidth, key->tileHeight, &min, &max);
+	if (data) munmap(data, bytes);
+	//clients can't change what other processes see
+	if (!ok || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+	{
+		close(fd);
+		return 0;
+	}
+	ServedTile* t = new ServedTile;
+	t->key = *key;
+	t->hash = HashNoiseCacheKey(key);
+	t->fd = fd;
+	t->bytes = bytes;
+	t->min = min;
+	t->max = max;
+	return t;
+}
+
+//Anything a client sends is checked, a single request can't be allowed to run for hours
+static bool validKey(const NoiseCacheKey* k)
+{
+	if (k->generator != SPHERE_SURFACE_SIMD) return false;
+	if (k->tileWidth < 1 || k->tileHeight < 1 || k->x0 < 0 || k->y0 < 0) return false;
+	if (k->width > TILE_SERVER_MAX_SIDE || k->height > TILE_SERVER_MAX_SIDE) return false;
+	if (k->x0 > k->width - k->tileWidth || k->y0 > k->height - k->tileHeight) return false;
+	if ((int64_t)k->tileWidth*k->tileHeight > TILE_SERVER_MAX_SAMPLES) return false;
+	const NoiseParams* P = &k->params;
+	if (P->octaves < 1 || P->octaves > TILE_SERVER_MAX_OCTAVES) return false;
+	if (!isfinite(P->frequency) || !isfinite(P->lacunarity) || !isfinite(P->gain) || !isfinite(P->offset)) return false;
+	if (P->fractalType < FBM || P->fractalType > PLAIN || P->noiseType < PERLIN || P->noiseType > SIMPLEX) return false;
+	return P->quality >= QUALITY_REFERENCE && P->quality <= QUALITY_FASTEST;
+}
+
+//One complete request of a client, false when the connection should be closed
+static bool serveRequest(TileServer* S, int client, const TileServerRequest& request)
+{
+	TileServerReply reply;
+	memset(&reply, 0, sizeof(reply));
+	reply.magic = TILE_SERVER_MAGIC;
+	if (request.magic != TILE_SERVER_MAGIC || request.version != TILE_SERVER_VERSION || !validKey(&request.key))
+	{
+		reply.status = TILE_BAD_REQUEST;
+		return sendAll(client, &reply, sizeof(reply));
+	}
+
+	//keys are compared whole, so only the fields a request can set may differ
+	NoiseCacheKey key;
+	memset(&key, 0, sizeof(key));
+	key.generator = request.key.generator;
+	key.width = request.key.width;
+	key.height = request.key.height;
+	key.x0 = request.key.x0;
+	key.y0 = request.key.y0;
+	key.tileWidth = request.key.tileWidth;
+	key.tileHeight = request.key.tileHeight;
+	key.params = request.key.params;
+	uint64_t hash = HashNoiseCacheKey(&key);
+
+	ServedTile* t = 0;
+	auto range = S->tiles.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (memcmp(&it->second->key, &key, sizeof(key)) == 0)
+		{
+			t = it->second;
+			break;
+		}
+	}
+	if (t) S->lru.splice(S->lru.begin(), S->lru, t->lru);
+	else
+	{
+		t = generateTile(&key);
+		if (!t)
+		{
+			reply.status = TILE_FAILED;
+			return sendAll(client, &reply, sizeof(reply));
+		}
+		S->lru.push_front(t);
+		t->lru = S->lru.begin();
+		S->tiles.insert(std::make_pair(hash, t));
+		S->bytes += t->bytes;
+	}
+	reply.status = TILE_SERVED;
+	reply.min = t->min;
+	reply.max = t->max;
+	reply.bytes = t->bytes;
+
+	iovec io = { &reply, sizeof(reply) };
+	char control[CMSG_SPACE(sizeof(int))];
+	memset(control, 0, sizeof(control));
+	msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &io;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+	cmsghdr* c = CMSG_FIRSTHDR(&message);
+	c->cmsg_level = SOL_SOCKET;
+	c->cmsg_type = SCM_RIGHTS;
+	c->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(c), &t->fd, sizeof(int));
+	ssize_t sent;
+	do sent = sendmsg(client, &message, MSG_NOSIGNAL);
+	while (sent < 0 && errno == EINTR);
+
+	//the tile just sent stays, it is the most recently used
+	auto it = S->lru.end();
+	while (S->bytes > S->budget && it != S->lru.begin())
+	{
+		--it;
+		if (*it == t) break;
+		auto next = it;
+		++next;
+		removeTile(S, *it);
+		it = next;
+	}
+	return sent == (ssize_t)sizeof(reply);
+}
+
+//Takes what the client has sent so far and serves every request it completes. False
+//when the connection should be closed, replies that don't fit in the socket buffer
+//(a client not reading them) included.
+static bool receiveRequests(TileServer* S, TileConnection* c)
+{
+	while (true)
+	{
+		ssize_t n = recv(c->socket, (char*)&c->request + c->received, sizeof(c->request) - c->received, 0);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+		if (n == 0) return false;
+		c->received += n;
+		if (c->received < sizeof(c->request)) continue;
+		c->received = 0;
+		if (!serveRequest(S, c->socket, c->request)) return false;
+	}
+}
+
+//Requests are served one at a time, generating a tile already uses every core
+static void serverLoop(TileServer* S)
+{
+	std::vector<pollfd> fds;
+	std::vector<TileConnection> connections; //connections[i] is fds[i + 2]
+	fds.push_back({ S->wake[0], POLLIN, 0 });
+	fds.push_back({ S->listener, POLLIN, 0 });
+	while (true)
+	{
+		if (poll(fds.data(), fds.size(), -1) < 0)
+		{
+			if (errno == EINTR) continue;
+			break;
+		}
+		if (fds[0].revents) break;
+		if (fds[1].revents & POLLIN)
+		{
+			int client = accept4(S->listener, 0, 0, SOCK_CLOEXEC | SOCK_NONBLOCK);
+			if (client >= 0)
+			{
+				TileConnection c;
+				memset(&c, 0, sizeof(c));
+				c.socket = client;
+				fds.push_back({ client, POLLIN, 0 });
+				connections.push_back(c);
+			}
+		}
+		for (size_t i = 2; i < fds.size(); i++)
+		{
+			if (!fds[i].revents) continue;
+			if ((fds[i].revents & POLLIN) && receiveRequests(S, &connections[i - 2])) continue;
+			close(fds[i].fd);
+			fds[i] = fds.back();
+			fds.pop_back();
+			connections[i - 2] = connections.back();
+			connections.pop_back();
+			i--;
+		}
+		for (pollfd& p : fds) p.revents = 0;
+	}
+	for (size_t i = 2; i < fds.size(); i++) close(fds[i].fd);
+}
+
+//A socket file left by a server that didn't stop cleanly would make bind fail. Only that
+//is removed: anything that isn't a socket, or a socket some server still accepts on, is
+//left alone and the start fails.
+static bool removeStaleSocket(const sockaddr_un* address)
+{
+	struct stat info;
+	if (lstat(address->sun_path, &info) != 0) return errno == ENOENT;
+	if (!S_ISSOCK(info.st_mode)) return false;
+	int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (probe < 0) return false;
+	bool stale = connect(probe, (const sockaddr*)address, sizeof(*address)) != 0 && errno == ECONNREFUSED;
+	close(probe);
+	return stale && unlink(address->sun_path) == 0;
+}
+
+TileServer* StartTileServer(const char* socketPath, size_t cacheBytes)
+{
+	sockaddr_un address;
+	if (!unixAddress(&address, socketPath)) return 0;
+	if (!removeStaleSocket(&address)) return 0;
+	int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listener < 0) return 0;
+	if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0)
+	{
+		close(listener);
+		return 0;
+	}
+	//owner only, and set before listen so nobody else can connect in between
+	if (chmod(socketPath, 0600) != 0 || listen(listener, 64) != 0)
+	{
+		close(listener);
+		unlink(socketPath);
+		return 0;
+	}
+	TileServer* S = new TileServer;
+	if (pipe2(S->wake, O_CLOEXEC) != 0)
+	{
+		close(listener);
+		unlink(socketPath);
+		delete S;
+		return 0;
+	}
+	S->listener = listener;
+	S->budget = cacheBytes;
+	S->bytes = 0;
+	strcpy(S->path, socketPath);
+	S->thread = std::thread(serverLoop, S);
+	return S;
+}
+
+void StopTileServer(TileServer* S)
+{
+	if (!S) return;
+	char c = 0;
+	while (write(S->wake[1], &c, 1) < 0 && errno == EINTR);
+	S->thread.join();
+	close(S->listener);
+	unlink(S->path);
+	close(S->wake[0]);
+	close(S->wake[1]);
+	while (!S->lru.empty()) removeTile(S, S->lru.front());
+	delete S;
+}
+
+TileClient* ConnectTileServer(const char* socketPath)
+{
+	sockaddr_un address;
+	if (!unixAddress(&address, socketPath)) return 0;
+	int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (s < 0) return 0;
+	if (connect(s, (sockaddr*)&address, sizeof(address)) != 0)
+	{
+		close(s);
+		return 0;
+	}
+	TileClient* client = new TileClient;
+	client->socket = s;
+	return client;
+}
+
+void DisconnectTileServer(TileClient* client)
+{
+	if (!client) return;
+	close(client->socket);
+	delete client;
+}
+
+const float* RequestSphereSurfaceTile(TileClient* client, const NoiseParams* params, int width, int height, int x0, int y0, int tileWidth, int tileHeight, float* outMin, float* outMax)
+{
+	TileServerRequest request;
+	memset(&request, 0, sizeof(request));
+	request.magic = TILE_SERVER_MAGIC;
+	request.version = TILE_SERVER_VERSION;
+	request.key.generator = SPHERE_SURFACE_SIMD;
+	request.key.width = width;
+	request.key.height = height;
+	request.key.x0 = x0;
+	request.key.y0 = y0;
+	request.key.tileWidth = tileWidth;
+	request.key.tileHeight = tileHeight;
+	request.key.params = *params;
+	if (!sendAll(client->socket, &request, sizeof(request))) return 0;
+
+	TileServerReply reply;
+	char control[CMSG_SPACE(sizeof(int))];
+	iovec io = { &reply, sizeof(reply) };
+	msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &io;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+	ssize_t n;
+	do n = recvmsg(client->socket, &message, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+	while (n < 0 && errno == EINTR);
+	int fd = -1;
+	cmsghdr* c = n > 0 ? CMSG_FIRSTHDR(&message) : 0;
+	if (c && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) memcpy(&fd, CMSG_DATA(c), sizeof(int));
+
+	const float* tile = 0;
+	if (n == (ssize_t)sizeof(reply) && reply.magic == TILE_SERVER_MAGIC && reply.status == TILE_SERVED && fd >= 0
+		&& reply.bytes == (uint64_t)tileWidth*tileHeight*sizeof(float))
+	{
+		void* p = mmap(0, reply.bytes, PROT_READ, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED)
+		{
+			tile = (const float*)p;
+			*outMin = reply.min;
+			*outMax = reply.max;
+		}
+	}
+	//the mapping keeps the segment alive on its own
+	if (fd >= 0) close(fd);
+	return tile;
+}
+
+void ReleaseServedTile(const float* tile, int tileWidth, int tileHeight)
+{
+	if (tile) munmap((void*)tile, (size_t)tileWidth*tileHeight*sizeof(float));
+}
+#endif
+
+#ifndef __linux__
+TileServer* StartTileServer(const char* socketPath, size_t cacheBytes)
+{
+	return 0;
+}
+
+void StopTileServer(TileServer* server)
+{
+}
+
+TileClient* ConnectTileServer(const char* socketPath)
+{
+	return 0;
+}
+
+void DisconnectTileServer(TileClient* client)
+{
+}
+
+const float* RequestSphereSurfaceTile(TileClient* client, const NoiseParams* params, int width, int height, int x0, int y0, int tileWidth, int tileHeight, float* outMin, float* outMax)
+{
+	return 0;
+}
+
+void ReleaseServedTile(const float* tile, int tileWidth, int tileHeight)
+{
+}
+#endif
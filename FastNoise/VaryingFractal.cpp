@@ -0,0 +1,263 @@
+#include "headers\VaryingFractal.h"
+#include "headers\TileScheduler.h"
+
+enum { VARYING_FREQUENCY, VARYING_GAIN, VARYING_OFFSET, VARYING_OCTAVES, VARYING_PARAMS };
+
+//A VaryingParam ready to evaluate
+struct VaryingControl
+{
+	Settings S; //of the secondary noise
+	SIMD dx; //its seed translation relative to the map's
+	SIMD dy;
+	SIMD dz;
+	SIMD value; //VARY_CONSTANT
+	SIMD low;
+	SIMD range;
+	int source;
+	const float* buffer;
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+};
+
+struct VaryingContext
+{
+	float* result;
+	const SphereTable* T;
+	const Settings* S;
+	const VaryingControl* controls;
+	ISIMDNoise3dN noiseFunction;
+	int fractalType;
+	int width;
+	int x0;
+	int y0;
+	int tileWidth;
+	float* chunkMin;
+	float* chunkMax;
+};
+
+//Values of one parameter for columns c.. of a row, lanes at or past end repeat the last column
+static void controlValues(SIMD* value, const VaryingControl* V, const float* row, int c, int end, const SIMD* x, const SIMD* y, const SIMD* z)
+{
+	switch (V->source)
+	{
+	case VARY_BUFFER:
+		for (int u = 0; u < KERNEL_UNROLL; u++)
+		{
+			int first = c + u*VECTOR_SIZE;
+			if (first + VECTOR_SIZE <= end)
+			{
+				value[u] = LoadU(row + first);
+				continue;
+			}
+			uSIMD v;
+			for (int j = 0; j < VECTOR_SIZE; j++) v.a[j] = row[first + j < end ? first + j : end - 1];
+			value[u] = v.m;
+		}
+		break;
+	case VARY_NOISE:
+	{
+		SIMD vx[KERNEL_UNROLL], vy[KERNEL_UNROLL], vz[KERNEL_UNROLL];
+		for (int u = 0; u < KERNEL_UNROLL; u++)
+		{
+			vx[u] = Add(x[u], V->dx);
+			vy[u] = Add(y[u], V->dy);
+			vz[u] = Add(z[u], V->dz);
+		}
+		V->fractalFunction(value, vx, vy, vz, &V->S, V->noiseFunction);
+		//-1..1 to low..high
+		SIMD half = SetOne(0.5f);
+		for (int u = 0; u < KERNEL_UNROLL; u++)
+		{
+			SIMD t = Min(Max(Add(Mul(value[u], half), half), zero), onef);
+			value[u] = Add(V->low, Mul(V->range, t));
+		}
+		break;
+	}
+	default:
+		for (int u = 0; u < KERNEL_UNROLL; u++) value[u] = V->value;
+	}
+}
+
+//The octave loop of the fractals with every parameter per lane. Octave i is weighted by
+//octaves - i clamped to 0..1, the loop ends once no lane has an octave left.
+static void varyingFractal(SIMD* out, const SIMD* x, const SIMD* y, const SIMD* z, SIMD value[VARYING_PARAMS][KERNEL_UNROLL], const VaryingContext* C)
+{
+	SIMD vfx[KERNEL_UNROLL], vfy[KERNEL_UNROLL], vfz[KERNEL_UNROLL], r[KERNEL_UNROLL];
+	SIMD frequency[KERNEL_UNROLL], amplitude[KERNEL_UNROLL], prev[KERNEL_UNROLL], octaves[KERNEL_UNROLL], weight[KERNEL_UNROLL];
+	SIMD maxOctaves = SetOne((float)VARYING_MAX_OCTAVES);
+	for (int u = 0; u < KERNEL_UNROLL; u++)
+	{
+		out[u] = SetZero();
+		amplitude[u] = SetOne(1.0f);
+		prev[u] = SetOne(1.0f);
+		frequency[u] = value[VARYING_FREQUENCY][u];
+		octaves[u] = Min(Max(value[VARYING_OCTAVES][u], onef), maxOctaves);
+	}
+	SIMD lacunarity = C->S->lacunarity;
+	for (int i = 0; ; i++)
+	{
+		SIMD octave = SetOne((float)i);
+		int active = 0;
+		for (int u = 0; u < KERNEL_UNROLL; u++)
+		{
+			active |= MoveMask(GreaterThan(octaves[u], octave));
+			weight[u] = Min(Sub(octaves[u], octave), onef);
+		}
+		if (!active) break;
+		for (int u = 0; u < KERNEL_UNROLL; u++)
+		{
+			vfx[u] = Mul(x[u], frequency[u]);
+			vfy[u] = Mul(y[u], frequency[u]);
+			vfz[u] = Mul(z[u], frequency[u]);
+		}
+		C->noiseFunction(r, vfx, vfy, vfz);
+		for (int u = 0; u < KERNEL_UNROLL; u++)
+		{
+			SIMD a;
+			switch (C->fractalType)
+			{
+			case TURBULENCE:
+				a = Mul(amplitude[u], r[u]);
+				a = Max(Sub(zero, a), a);
+				break;
+			case RIDGE:
+				a = Max(Sub(zero, r[u]), r[u]);
+				a = Sub(value[VARYING_OFFSET][u], a);
+				a = Mul(a, a);
+				a = Mul(a, amplitude[u]);
+				a = Mul(a, prev[u]);
+				prev[u] = a;
+				break;
+			default:
+				a = Mul(amplitude[u], r[u]);
+			}
+			//lanes past their last octave have a weight of zero or less
+			out[u] = Add(out[u], And(Mul(weight[u], a), GreaterThan(weight[u], zero)));
+			frequency[u] = Mul(frequency[u], lacunarity);
+			amplitude[u] = Mul(amplitude[u], value[VARYING_GAIN][u]);
+		}
+	}
+}
+
+static void varyingChunk(void* context, int begin, int end, int chunk)
+{
+	const VaryingContext* C = (const VaryingContext*)context;
+	Settings S = *C->S;
+	SIMD min = SetOne(999);
+	SIMD max = SetOne(-999);
+	SIMD x[KERNEL_UNROLL], vy[KERNEL_UNROLL], z[KERNEL_UNROLL], r[KERNEL_UNROLL];
+	SIMD value[VARYING_PARAMS][KERNEL_UNROLL];
+	int x1 = C->x0 + C->tileWidth;
+	for (int y = begin; y < end; y = y + 1)
+	{
+		int row = C->y0 + y;
+		float* out = C->result + (size_t)y*C->tileWidth;
+		float sinPhi = SphereRowSIMD(&S, C->T, row);
+		for (int u = 0; u < KERNEL_UNROLL; u++) z[u] = S.z.m;
+		for (int c = C->x0; c < x1; c = c + VECTOR_SIZE*KERNEL_UNROLL)
+		{
+			for (int u = 0; u < KERNEL_UNROLL; u++)
+			{
+				SphereVectorSIMD(&S, C->T, c + u*VECTOR_SIZE, x1, sinPhi);
+				x[u] = S.x.m;
+				vy[u] = S.y.m;
+			}
+			for (int p = 0; p < VARYING_PARAMS; p++)
+			{
+				const VaryingControl* V = &C->controls[p];
+				const float* values = V->buffer ? V->buffer + (size_t)row*C->width : 0;
+				controlValues(value[p], V, values, c, x1, x, vy, z);
+			}
+			varyingFractal(r, x, vy, z, value, C);
+			for (int u = 0; u < KERNEL_UNROLL; u++)
+			{
+				int count = x1 - (c + u*VECTOR_SIZE);
+				if (count <= 0) break;
+				min = Min(min, r[u]);
+				max = Max(max, r[u]);
+				StorePartial(out + (c + u*VECTOR_SIZE - C->x0), r[u], count < VECTOR_SIZE ? count : VECTOR_SIZE);
+			}
+		}
+	}
+	ReduceMinMax(&min, &max, &C->chunkMin[chunk], &C->chunkMax[chunk]);
+}
+
+static bool initControl(VaryingControl* V, const VaryingParam* P, float constant, const float* seedOffset)
+{
+	V->source = P->source;
+	V->value = SetOne(constant);
+	V->buffer = 0;
+	switch (P->source)
+	{
+	case VARY_CONSTANT:
+		return true;
+	case VARY_BUFFER:
+		V->buffer = P->buffer;
+		return P->buffer != 0;
+	case VARY_NOISE:
+	{
+		const NoiseParams* N = &P->noise;
+		if (!SelectFractalSIMD(N->fractalType, N->octaves, &V->fractalFunction)) return false;
+		if (!SelectNoiseSIMD(N->noiseType, &V->noiseFunction, N->quality)) return false;
+		initSIMD(&V->S, N->frequency, N->lacunarity, N->offset, N->gain, N->octaves);
+		float x, y, z;
+		SeedOffset(N->seed, &x, &y, &z);
+		V->dx = SetOne(x - seedOffset[0]);
+		V->dy = SetOne(y - seedOffset[1]);
+		V->dz = SetOne(z - seedOffset[2]);
+		V->low = SetOne(P->low);
+		V->range = SetOne(P->high - P->low);
+		return true;
+	}
+	}
+	return false;
+}
+
+bool FillSphereSurfaceVaryingSIMD(float* result, const NoiseParams* P, const VaryingFractalParams* varying, int width, int height, int x0, int y0, int tileWidth, int tileHeight, float* __restrict outMin, float* __restrict outMax)
+{
+	ISIMDFractal3dN fractalFunction;
+	ISIMDNoise3dN noiseFunction;
+	if (!SelectFractalSIMD(P->fractalType, P->octaves, &fractalFunction)) return false;
+	if (!SelectNoiseSIMD(P->noiseType, &noiseFunction, P->quality)) return false;
+	if (x0 < 0 || y0 < 0 || tileWidth < 1 || tileHeight < 1 || x0 + tileWidth > width || y0 + tileHeight > height) return false;
+
+	float seedOffset[3];
+	SeedOffset(P->seed, &seedOffset[0], &seedOffset[1], &seedOffset[2]);
+	VaryingControl controls[VARYING_PARAMS];
+	const VaryingParam* params[VARYING_PARAMS] = { &varying->frequency, &varying->gain, &varying->offset, &varying->octaves };
+	float constants[VARYING_PARAMS] = { P->frequency, P->gain, P->offset, (float)P->octaves };
+	for (int p = 0; p < VARYING_PARAMS; p++)
+	{
+		if (!initControl(&controls[p], params[p], constants[p], seedOffset)) return false;
+	}
+	//plain is one octave whatever the count says. Like the dense path a constant single
+	//octave of turbulence is plain signed noise, and of ridge |n|, which is what one octave
+	//of turbulence gives here. A varying count keeps each type's own form below two
+	//octaves, so the map doesn't jump where the count crosses one.
+	int fractalType = P->fractalType;
+	if (controls[VARYING_OCTAVES].source == VARY_CONSTANT && P->octaves == 1)
+	{
+		if (fractalType == TURBULENCE) fractalType = PLAIN;
+		else if (fractalType == RIDGE) fractalType = TURBULENCE;
+	}
+	if (fractalType == PLAIN)
+	{
+		controls[VARYING_OCTAVES].source = VARY_CONSTANT;
+		controls[VARYING_OCTAVES].value = onef;
+	}
+
+	SphereTable T;
+	InitSphereTable(&T, width, height, P->seed);
+	Settings S;
+	initSIMD(&S, P->frequency, P->lacunarity, P->offset, P->gain, P->octaves);
+
+	int grain = GetSchedulerGrain();
+	int chunks = ChunkCount(tileHeight, grain);
+	VaryingContext C = { result, &T, &S, controls, noiseFunction, fractalType, width, x0, y0, tileWidth, new float[chunks], new float[chunks] };
+	ParallelFor(tileHeight, grain, varyingChunk, &C);
+	ReduceChunkMinMax(C.chunkMin, C.chunkMax, chunks, outMin, outMax);
+	delete[] C.chunkMin;
+	delete[] C.chunkMax;
+	FreeSphereTable(&T);
+	return true;
+}
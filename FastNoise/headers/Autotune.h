@@ -0,0 +1,32 @@
+#pragma once
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+#include "NoiseUtility.h"
+
+//Environment variable naming a profile that is loaded before the first generator runs
+#define PROFILE_ENV "FASTNOISE_PROFILE"
+
+//Choices the generators make at run time
+typedef struct
+{
+	int unroll;  //vectors the Perlin kernel interleaves, divides KERNEL_UNROLL
+	int gather;  //perm lookups with AVX2 gathers (1) or scalar loads (0)
+	int grain;   //rows per scheduler chunk
+	int threads; //scheduler workers, 0 for one per hardware thread
+} KernelConfig;
+
+extern "C" {
+	FAST_NOISE_DLL_API extern void GetKernelConfig(KernelConfig* config);
+	//threads only change while no generator is running
+	FAST_NOISE_DLL_API extern void SetKernelConfig(const KernelConfig* config);
+	//Benchmarks the variants on this cpu, applies the fastest and writes them to
+	//profilePath unless it is null. Call while no generator is running.
+	FAST_NOISE_DLL_API extern bool AutotuneKernels(const char* profilePath, KernelConfig* result);
+	//Applies a profile written by AutotuneKernels on the same cpu model
+	FAST_NOISE_DLL_API extern bool LoadKernelProfile(const char* profilePath);
+}
+
+//Config the generators use, the PROFILE_ENV profile is loaded on the first call
+const KernelConfig* CurrentKernelConfig();
+
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+#ifndef CULLEDVOLUME_H
+#define CULLEDVOLUME_H
+#include "NoiseUtility.h"
+#include <stdint.h>
+
+//Edge of the blocks FillVolumeCulledSIMD classifies, halved down to LEAF_SIZE
+#define VOLUME_BLOCK 8
+#define VOLUME_LEAF 2
+
+enum VolumeBlockState { BLOCK_BELOW, BLOCK_ABOVE, BLOCK_CROSSING };
+
+extern "C" {
+	//Fills a sizeX x sizeY x sizeZ grid, x fastest, with the noise at origin + (x,y,z)*spacing,
+	//evaluating only the parts that may cross threshold. Regions proven to lie above or below
+	//it get a value on the same side instead, so every sample with one of its 26 neighbours
+	//on the other side of threshold is exact. blockState (may be null) receives a
+	//VolumeBlockState per VOLUME_BLOCK^3 block, outEvaluated (may be null) the number
+	//of samples that were evaluated.
+	FAST_NOISE_DLL_API extern bool FillVolumeCulledSIMD(float* result, unsigned char* blockState, const NoiseParams* params, float originX, float originY, float originZ, float spacing, int sizeX, int sizeY, int sizeZ, float threshold, int64_t* outEvaluated);
+}
+
+#endif
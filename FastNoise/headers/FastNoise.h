@@ -24,6 +24,29 @@
 #define SSE41 //indicates we want SSE4.1 instructions (floor is available)
 #define AVX2 //indicates we want AVX2 instructions (double speed!) 
 #define USEGATHER  //use the avx gather instruction to index the perm array
+#define F16C //indicates we have the F16C half float conversions (used for compact octave layers)
+//#define NOISE_STATS //collect per phase timings of the bulk generators, see NoiseStats.h
+//#define DETERMINISTIC //bit identical output on every ISA tier, compiler and thread count, see README
+
+#ifdef DETERMINISTIC
+//no fused multiply-adds, every Mul and Add rounds on its own like on cpus without FMA
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#elif defined(_MSC_VER)
+#pragma fp_contract(off)
+#endif
+#endif
+
+//number of independent vectors the multi vector kernels work on at once (the *N functions),
+//4 was fastest for both widths, 1 gives the old one vector at a time behaviour
+#ifdef AVX2
+#define KERNEL_UNROLL 4
+#endif
+#ifndef AVX2
+#define KERNEL_UNROLL 4
+#endif
 
 //creat types we can use in either the 128 or 256 case
 #ifndef AVX2
@@ -38,6 +61,8 @@ typedef __m128i SIMDi;
 //intrinsic functions
 #define Store(x,y) _mm_store_ps(x,y)
 #define Load(x) _mm_load_ps(x)
+#define StoreU(x,y) _mm_storeu_ps(x,y)
+#define LoadU(x) _mm_loadu_ps(x)
 #define SetOne(x) _mm_set1_ps(x)
 #define SetZero() _mm_setzero_ps()
 #define SetOnei(x) _mm_set1_epi32(x)
@@ -53,6 +78,10 @@ typedef __m128i SIMDi;
 #define AndNot(x,y) _mm_andnot_ps(x,y)
 #define Or(x,y) _mm_or_ps(x,y)
 #define Ori(x,y) _mm_or_si128(x,y)
+#define Xori(x,y) _mm_xor_si128(x,y)
+#define Xor(x,y) _mm_xor_ps(x,y)
+#define ShiftLefti(x,n) _mm_slli_epi32(x,n)
+#define ShiftRighti(x,n) _mm_srli_epi32(x,n)
 #define CastToFloat(x) _mm_castsi128_ps(x)
 #define CastToInt(x) _mm_castps_si128(x)
 #define ConvertToInt(x) _mm_cvtps_epi32(x)
@@ -70,6 +99,32 @@ typedef __m128i SIMDi;
 #define Max(x,y) _mm_max_ps(x,y)
 #define Maxi(x,y) _mm_max_epi32(x,y)
 #define Min(x,y) _mm_min_ps(x,y)
+#define HAddPairs(x,y) _mm_hadd_ps(x,y) //x0+x1,x2+x3,y0+y1,y2+y3
+#define MoveMask(x) _mm_movemask_ps(x) //sign bit of every lane, bit i for lane i
+#ifdef SSE41
+//16 bit fixed point lanes, 2*VECTOR_SIZE of them per SIMDi
+#define SetOne16(x) _mm_set1_epi16(x)
+#define Add16(x,y) _mm_add_epi16(x,y)
+#define AddSat16(x,y) _mm_adds_epi16(x,y)
+#define Sub16(x,y) _mm_sub_epi16(x,y)
+#define MulFixed16(x,y) _mm_mulhrs_epi16(x,y) //(x*y + 2^14) >> 15, a Q15 multiply
+#define Min16(x,y) _mm_min_epi16(x,y)
+#define Max16(x,y) _mm_max_epi16(x,y)
+#define Sign16(x,y) _mm_sign_epi16(x,y) //-x where y < 0, 0 where y is 0
+#define Equal16(x,y) _mm_cmpeq_epi16(x,y)
+#define LessThan16(x,y) _mm_cmpgt_epi16(y,x)
+#define ShiftLeft16(x,n) _mm_slli_epi16(x,n)
+#define Selecti(m,x,y) _mm_blendv_epi8(y,x,m) //x where m is set, else y
+#define Pack16(x,y) _mm_packs_epi32(x,y) //saturating, x in the low lanes
+#define StoreU16(x,y) _mm_storeu_si128((__m128i*)(x),y)
+#define TruncateToInt(x) _mm_cvttps_epi32(x)
+#define MulLowi(x,y) _mm_mullo_epi32(x,y) //low 32 bits of the products
+#endif
+#ifdef F16C
+//VECTOR_SIZE half floats to and from memory
+#define StoreHalf(x,y) _mm_storel_epi64((__m128i*)(x), _mm_cvtps_ph(y, _MM_FROUND_TO_NEAREST_INT))
+#define LoadHalf(x) _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(x)))
+#endif
 #endif
 #ifdef AVX2
 
@@ -84,6 +139,8 @@ typedef __m256i SIMDi;
 //intrinsic functions
 #define Store(x,y) _mm256_store_ps(x,y)
 #define Load(x) _mm256_load_ps(x)
+#define StoreU(x,y) _mm256_storeu_ps(x,y)
+#define LoadU(x) _mm256_loadu_ps(x)
 #define Set(x,y,z,w,a,b,c,d) _mm256_set_ps(x,y,z,w,a,b,c,d);
 #define SetOne(x) _mm256_set1_ps(x)
 #define SetZero() _mm256_setzero_ps()
@@ -100,6 +157,10 @@ typedef __m256i SIMDi;
 #define AndNot(x,y) _mm256_andnot_ps(x,y)
 #define Or(x,y) _mm256_or_ps(x,y)
 #define Ori(x,y) _mm256_or_si256(x,y)
+#define Xori(x,y) _mm256_xor_si256(x,y)
+#define Xor(x,y) _mm256_xor_ps(x,y)
+#define ShiftLefti(x,n) _mm256_slli_epi32(x,n)
+#define ShiftRighti(x,n) _mm256_srli_epi32(x,n)
 #define CastToFloat(x) _mm256_castsi256_ps(x)
 #define CastToInt(x) _mm256_castps_si256(x)
 #define ConvertToInt(x) _mm256_cvtps_epi32(x)
@@ -117,12 +178,54 @@ typedef __m256i SIMDi;
 #define Max(x,y) _mm256_max_ps(x,y)
 #define Maxi(x,y) _mm256_max_epi32(x,y)
 #define Min(x,y) _mm256_min_ps(x,y)
+#define MoveMask(x) _mm256_movemask_ps(x) //sign bit of every lane, bit i for lane i
 #define Gather(x,y,z) _mm256_i32gather_epi32(x,y,z)
 #define Gatherf(x,y,z) _mm256_i32gather_ps(x,y,z);
+//x0+x1..x6+x7,y0+y1..y6+y7, hadd works per 128 bit lane so put the pairs back in order
+#define HAddPairs(x,y) _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_hadd_ps(x,y)), 0xD8))
+//16 bit fixed point lanes, 2*VECTOR_SIZE of them per SIMDi
+#define SetOne16(x) _mm256_set1_epi16(x)
+#define Add16(x,y) _mm256_add_epi16(x,y)
+#define AddSat16(x,y) _mm256_adds_epi16(x,y)
+#define Sub16(x,y) _mm256_sub_epi16(x,y)
+#define MulFixed16(x,y) _mm256_mulhrs_epi16(x,y) //(x*y + 2^14) >> 15, a Q15 multiply
+#define Min16(x,y) _mm256_min_epi16(x,y)
+#define Max16(x,y) _mm256_max_epi16(x,y)
+#define Sign16(x,y) _mm256_sign_epi16(x,y) //-x where y < 0, 0 where y is 0
+#define Equal16(x,y) _mm256_cmpeq_epi16(x,y)
+#define LessThan16(x,y) _mm256_cmpgt_epi16(y,x)
+#define ShiftLeft16(x,n) _mm256_slli_epi16(x,n)
+#define Selecti(m,x,y) _mm256_blendv_epi8(y,x,m) //x where m is set, else y
+//saturating, x in the low lanes (packs works per 128 bit half, the permute restores the order)
+#define Pack16(x,y) _mm256_permute4x64_epi64(_mm256_packs_epi32(x,y), 0xD8)
+#define StoreU16(x,y) _mm256_storeu_si256((__m256i*)(x),y)
+#define TruncateToInt(x) _mm256_cvttps_epi32(x)
+#define MulLowi(x,y) _mm256_mullo_epi32(x,y) //low 32 bits of the products
+#ifdef F16C
+//VECTOR_SIZE half floats to and from memory
+#define StoreHalf(x,y) _mm_storeu_si128((__m128i*)(x), _mm256_cvtps_ph(y, _MM_FROUND_TO_NEAREST_INT))
+#define LoadHalf(x) _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(x)))
+#endif
 #endif
 
 
 
+#ifdef DETERMINISTIC
+//Round to nearest with denormals kept (the default control word) while the object
+//lives, whatever flush to zero or rounding mode the calling thread was left with
+struct FixedFloatState
+{
+	unsigned int csr;
+	FixedFloatState() { csr = _mm_getcsr(); _mm_setcsr(0x1F80); }
+	~FixedFloatState() { _mm_setcsr(csr); }
+};
+#define FIXED_FLOAT_STATE() FixedFloatState fixedFloatState
+#endif
+#ifndef DETERMINISTIC
+#define FIXED_FLOAT_STATE()
+#endif
+
+
 #define SCALE 1.754f
 #define OFFSET .05f
 #define PI 3.141593f
@@ -158,6 +261,10 @@ typedef struct
 
 enum FractalType { FBM, TURBULENCE, RIDGE, PLAIN};
 enum NoiseType {PERLIN, SIMPLEX};
+//Cheaper kernel variants, see README for their error and speed. FAST keeps the perm rounds
+//over z and y and hashes x arithmetically, FASTEST hashes every axis arithmetically. Both
+//give a different (and isotropic) pattern from the reference.
+enum NoiseQuality { QUALITY_REFERENCE, QUALITY_FAST, QUALITY_FASTEST };
 
 
 
@@ -165,6 +272,11 @@ typedef SIMD(*ISIMDNoise3d)(SIMD* x, SIMD* y, SIMD* z);
 typedef float(*INoise3d)(float x, float y, float z);
 
 typedef void(*ISIMDFractal3d)(SIMD* out,Settings*,ISIMDNoise3d);
+//KERNEL_UNROLL vectors per call
+typedef void(*ISIMDNoise3dN)(SIMD* out, const SIMD* x, const SIMD* y, const SIMD* z);
+typedef void(*ISIMDFractal3dN)(SIMD* out, const SIMD* x, const SIMD* y, const SIMD* z, const Settings*, ISIMDNoise3dN);
+//lo..hi bounds the noise over balls of the given radius around x,y,z
+typedef void(*ISIMDNoiseBound3d)(SIMD* lo, SIMD* hi, SIMD* x, SIMD* y, SIMD* z, SIMD* radius);
 typedef float(*IFractal3d)(float, float, float, float, float, float, int, float,INoise3d);
 
 
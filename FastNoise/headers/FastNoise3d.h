@@ -3,12 +3,47 @@
 #define FASTNOISE3D_H
 #include "FastNoise.h"
 
+//Largest magnitude a single octave of each noise reaches, measured over large maps with some margin
+#define PERLIN_BOUND 2.0f
+#define SIMPLEX_BOUND 1.5f
+//Largest change of each noise per unit of distance. Measured maxima are 5.6 for Perlin
+//and 7.5 for simplex, which also steps by up to 0.0063 where a corner still inside its
+//0.6 radius leaves the simplex; the constants below add margin to both.
+#define PERLIN_LIPSCHITZ 6.5f
+#define SIMPLEX_LIPSCHITZ 9.0f
+#define SIMPLEX_STEP 0.02f
+//Float rounding of the kernels
+#define NOISE_BOUND_EPSILON 1e-5f
+//1.0 in the Q14 output of perlinSIMD3dI16, and the largest difference from perlinSIMD3d
+//measured in those units (see README)
+#define PERLIN_I16_ONE 16384
+#define PERLIN_I16_ERROR 12
+
 
 extern "C" {
 	FAST_NOISE_DLL_API inline extern SIMD simplexSIMD3d(SIMD* x, SIMD* y, SIMD* z);		
 	FAST_NOISE_DLL_API inline extern float simplex3d(float x, float y, float z);
 	FAST_NOISE_DLL_API inline extern float perlin3d(float x, float y, float z);
 	FAST_NOISE_DLL_API inline extern SIMD perlinSIMD3d(SIMD* __restrict x, SIMD* __restrict y, SIMD* __restrict z);
+	FAST_NOISE_DLL_API inline extern void simplexSIMD3dN(SIMD* __restrict out, const SIMD* __restrict x, const SIMD* __restrict y, const SIMD* __restrict z);
+	FAST_NOISE_DLL_API inline extern void perlinSIMD3dN(SIMD* __restrict out, const SIMD* __restrict x, const SIMD* __restrict y, const SIMD* __restrict z);
+
+	//Perlin noise in 16 bit fixed point for 8 and 16 bit outputs. x, y and z point to two
+	//vectors each, out gets their 2*VECTOR_SIZE values as Q14 (PERLIN_I16_ONE is 1.0).
+	//Needs SSE41, without it the float kernel is rounded instead.
+	FAST_NOISE_DLL_API extern void perlinSIMD3dI16(int16_t* __restrict out, const SIMD* __restrict x, const SIMD* __restrict y, const SIMD* __restrict z);
+
+	//Conservative lo..hi of the noise over balls of radius around x,y,z
+	FAST_NOISE_DLL_API extern void perlinBoundSIMD3d(SIMD* lo, SIMD* hi, SIMD* x, SIMD* y, SIMD* z, SIMD* radius);
+	FAST_NOISE_DLL_API extern void simplexBoundSIMD3d(SIMD* lo, SIMD* hi, SIMD* x, SIMD* y, SIMD* z, SIMD* radius);
 }
 
+//Variants of the kernels above picked at run time (see Autotune.h). gather is
+//ignored without USEGATHER, unroll is the number of vectors the Perlin kernel
+//interleaves and has to divide KERNEL_UNROLL, quality is a NoiseQuality.
+ISIMDNoise3d SelectNoiseKernel(int noiseType, bool gather, int quality = QUALITY_REFERENCE);
+ISIMDNoise3dN SelectNoiseKernelN(int noiseType, int unroll, bool gather, int quality = QUALITY_REFERENCE);
+//Bound function of the kernel of that type and quality
+ISIMDNoiseBound3d SelectNoiseBound(int noiseType, int quality);
+
 #endif
@@ -14,6 +14,16 @@ extern "C"
 	FAST_NOISE_DLL_API inline extern void ridgeSIMD3d(SIMD* out, Settings* S, ISIMDNoise3d noise);
 	FAST_NOISE_DLL_API inline extern void ridgePlainSIMD3d(SIMD* __restrict out, Settings* __restrict S, ISIMDNoise3d noise);
 
+	//KERNEL_UNROLL coordinate vectors at a time, same results as the functions above
+	FAST_NOISE_DLL_API inline extern void fbmSIMD3dN(SIMD* out, const SIMD* x, const SIMD* y, const SIMD* z, const Settings* S, ISIMDNoise3dN noise);
+	FAST_NOISE_DLL_API inline extern void plainSIMD3dN(SIMD* out, const SIMD* x, const SIMD* y, const SIMD* z, const Settings* S, ISIMDNoise3dN noise);
+	FAST_NOISE_DLL_API inline extern void turbulenceSIMD3dN(SIMD* out, const SIMD* x, const SIMD* y, const SIMD* z, const Settings* S, ISIMDNoise3dN noise);
+	FAST_NOISE_DLL_API inline extern void ridgeSIMD3dN(SIMD* out, const SIMD* x, const SIMD* y, const SIMD* z, const Settings* S, ISIMDNoise3dN noise);
+	FAST_NOISE_DLL_API inline extern void ridgePlainSIMD3dN(SIMD* out, const SIMD* x, const SIMD* y, const SIMD* z, const Settings* S, ISIMDNoise3dN noise);
+
+	//Conservative lo..hi of a fractal over balls of radius around S->x,y,z
+	FAST_NOISE_DLL_API extern void fractalBoundSIMD3d(SIMD* lo, SIMD* hi, Settings* S, SIMD radius, int fractalType, ISIMDNoiseBound3d bound);
+
 
 	FAST_NOISE_DLL_API inline extern float fbm3d(float x, float y, float z, float frequency, float lacunarity, float gain, int octaves, float offset,INoise3d noise);
 	FAST_NOISE_DLL_API inline extern float plain3d(float x, float y, float z, float frequency, float lacunarity, float gain, int octaves, float offset, INoise3d noise);
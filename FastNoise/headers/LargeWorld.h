@@ -0,0 +1,16 @@
+#pragma once
+#ifndef LARGEWORLD_H
+#define LARGEWORLD_H
+#include "NoiseUtility.h"
+
+//Both noises repeat along each axis, perlin every 256 lattice cells and
+//simplex every 768 (a shift of 768 is 1024 cells in its skewed lattice)
+#define PERLIN_PERIOD 256.0
+#define SIMPLEX_PERIOD 768.0
+
+extern "C" {
+	FAST_NOISE_DLL_API extern bool FillWorldTileSIMD(float* result, const NoiseParams* params, double originX, double originY, double originZ, float spacing, int width, int height, float* outMin, float* outMax);
+	FAST_NOISE_DLL_API extern bool FillWorldTileLatticeSIMD(float* result, const NoiseParams* params, const int64_t* latticeOrigin, const float* localOrigin, float spacing, int width, int height, float* outMin, float* outMax);
+}
+
+#endif
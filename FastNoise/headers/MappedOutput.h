@@ -0,0 +1,45 @@
+#pragma once
+#ifndef MAPPEDOUTPUT_H
+#define MAPPEDOUTPUT_H
+#include "NoiseUtility.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define MAPPED_NOISE_MAGIC 0x4D4E5346 //"FSNM"
+#define MAPPED_NOISE_VERSION 2
+//Samples start this far into the file so they can be mapped page aligned
+#define MAPPED_NOISE_HEADER_SIZE 4096
+
+enum MappedNoiseFormat { MAPPED_FLOAT32, MAPPED_UINT16 };
+
+//Start of every file written by WriteSphereSurfaceFile. Samples are row major,
+//or with tileSize > 0 stored as whole tileSize x tileSize tiles (row major inside
+//a tile and across tiles, edge tiles padded with zeros).
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t headerSize;
+	int32_t format;
+	int32_t width;
+	int32_t height;
+	int32_t tileSize;
+	int32_t complete; //0 until every band has been written
+	NoiseParams params;
+	float min;
+	float max;
+	//uint16 sample q stands for rangeMin + q * (rangeMax - rangeMin) / 65535
+	float rangeMin;
+	float rangeMax;
+} MappedNoiseHeader;
+
+extern "C" {
+	FAST_NOISE_DLL_API extern bool WriteSphereSurfaceFile(const char* path, const NoiseParams* params, int width, int height, int format, int tileSize, float* outMin, float* outMax);
+	//Bound on the output of params used as the uint16 range, known before anything is generated
+	FAST_NOISE_DLL_API extern void GetNoiseRangeBound(const NoiseParams* params, float* rangeMin, float* rangeMax);
+	//Maps a file read only, samples are at (char*)header + header->headerSize
+	FAST_NOISE_DLL_API extern const MappedNoiseHeader* MapNoiseFile(const char* path);
+	FAST_NOISE_DLL_API extern void UnmapNoiseFile(const MappedNoiseHeader* header);
+}
+
+#endif
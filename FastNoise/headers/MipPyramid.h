@@ -0,0 +1,17 @@
+#pragma once
+#ifndef MIPPYRAMID_H
+#define MIPPYRAMID_H
+#include "NoiseUtility.h"
+#include <stddef.h>
+
+//BOX filters every level from the one below it, DIRECT evaluates every level
+//at its own resolution with one octave less per level
+enum MipMode { MIP_BOX, MIP_DIRECT };
+
+extern "C" {
+	FAST_NOISE_DLL_API extern int GetMipLevelCount(int width, int height);
+	FAST_NOISE_DLL_API extern size_t GetMipLevelOffset(int width, int height, int level, int* levelWidth, int* levelHeight);
+	FAST_NOISE_DLL_API extern float* GetSphereSurfaceMipsSIMD(const NoiseParams* params, int width, int height, int mipMode, int* outLevels, float* outMin, float* outMax);
+}
+
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+#ifndef MULTICHANNEL_H
+#define MULTICHANNEL_H
+#include "NoiseUtility.h"
+
+#define MAX_CHANNELS 16
+
+//INTERLEAVED stores the channels of a sample next to each other,
+//PLANAR stores one whole width x height map per channel
+enum ChannelLayout { CHANNELS_INTERLEAVED, CHANNELS_PLANAR };
+
+extern "C" {
+	//outMin and outMax receive one value per channel
+	FAST_NOISE_DLL_API extern bool FillSphereSurfaceChannelsSIMD(float* result, const NoiseParams* params, int channels, int width, int height, int layout, float* outMin, float* outMax);
+	FAST_NOISE_DLL_API extern float* GetSphereSurfaceChannelsSIMD(const NoiseParams* params, int channels, int width, int height, int layout, float* outMin, float* outMax);
+}
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+#ifndef NOISECACHE_H
+#define NOISECACHE_H
+#include "NoiseUtility.h"
+#include <stddef.h>
+
+//Everything that determines the output of a cached generator
+typedef struct
+{
+	int generator;
+	int width;
+	int height;
+	int x0;
+	int y0;
+	int tileWidth;
+	int tileHeight;
+	NoiseParams params;
+} NoiseCacheKey;
+
+enum NoiseCacheGenerator { SPHERE_SURFACE_SIMD };
+
+extern "C" {
+	FAST_NOISE_DLL_API extern void SetNoiseCacheBudget(size_t bytes);
+	FAST_NOISE_DLL_API extern void ClearNoiseCache();
+	FAST_NOISE_DLL_API extern uint64_t HashNoiseCacheKey(const NoiseCacheKey* key);
+	FAST_NOISE_DLL_API extern const float* GetSphereSurfaceTileCached(const NoiseParams* params, int width, int height, int x0, int y0, int tileWidth, int tileHeight, float* outMin, float* outMax);
+	FAST_NOISE_DLL_API extern void ReleaseCachedNoise(const float* resultArray);
+}
+
+#endif
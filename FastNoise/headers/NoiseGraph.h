@@ -0,0 +1,36 @@
+#pragma once
+#ifndef NOISEGRAPH_H
+#define NOISEGRAPH_H
+#include "NoiseUtility.h"
+
+enum NoiseGraphOp { GRAPH_SOURCE, GRAPH_CONSTANT, GRAPH_ADD, GRAPH_MULTIPLY, GRAPH_MIN, GRAPH_MAX, GRAPH_SELECT, GRAPH_CLAMP, GRAPH_SCALE_BIAS, GRAPH_CURVE };
+
+//Intermediates of one SIMD vector live in a small array of slots, graphs that
+//need more values alive at once than this fail to compile
+#define GRAPH_MAX_SLOTS 32
+
+typedef struct NoiseGraph NoiseGraph;
+
+//Nodes are returned as ids and may only use nodes created before them, so a
+//graph can never contain a cycle. Every function returns -1 on bad input.
+extern "C" {
+	FAST_NOISE_DLL_API extern NoiseGraph* CreateNoiseGraph();
+	FAST_NOISE_DLL_API extern void CleanUpNoiseGraph(NoiseGraph* graph);
+
+	FAST_NOISE_DLL_API extern int NoiseGraphSource(NoiseGraph* graph, const NoiseParams* params);
+	FAST_NOISE_DLL_API extern int NoiseGraphConstant(NoiseGraph* graph, float value);
+	//GRAPH_ADD, GRAPH_MULTIPLY, GRAPH_MIN or GRAPH_MAX of a and b
+	FAST_NOISE_DLL_API extern int NoiseGraphBinary(NoiseGraph* graph, int op, int a, int b);
+	//a where control < threshold, b above it, blended with an s-curve within falloff of the threshold
+	FAST_NOISE_DLL_API extern int NoiseGraphSelect(NoiseGraph* graph, int control, int a, int b, float threshold, float falloff);
+	FAST_NOISE_DLL_API extern int NoiseGraphClamp(NoiseGraph* graph, int source, float low, float high);
+	FAST_NOISE_DLL_API extern int NoiseGraphScaleBias(NoiseGraph* graph, int source, float scale, float bias);
+	//piecewise linear curve through count x,y pairs sorted by x, held flat outside them
+	FAST_NOISE_DLL_API extern int NoiseGraphCurve(NoiseGraph* graph, int source, const float* points, int count);
+
+	//Flattens everything output depends on into an instruction list
+	FAST_NOISE_DLL_API extern bool CompileNoiseGraph(NoiseGraph* graph, int output);
+	FAST_NOISE_DLL_API extern float* GetSphereSurfaceGraphSIMD(const NoiseGraph* graph, int width, int height, float* outMin, float* outMax);
+}
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+#ifndef NOISEJOBS_H
+#define NOISEJOBS_H
+#include "NoiseUtility.h"
+
+enum NoiseJobStatus { JOB_RUNNING, JOB_DONE, JOB_CANCELLED };
+
+typedef struct NoiseJob NoiseJob;
+
+//Called once, from the thread that ran the last band, when the job stops for any
+//reason. The job's status stays JOB_RUNNING and waiters keep waiting until this
+//returns, so it must not wait on its own job.
+typedef void(*NoiseJobCallback)(NoiseJob* job, int status, void* userData);
+
+extern "C" {
+	FAST_NOISE_DLL_API extern NoiseJob* SubmitSphereSurfaceJob(const NoiseParams* params, int width, int height, NoiseJobCallback callback, void* userData);
+	FAST_NOISE_DLL_API extern int GetNoiseJobStatus(NoiseJob* job);
+	FAST_NOISE_DLL_API extern float GetNoiseJobProgress(NoiseJob* job, int* rowsDone, int* rowsTotal);
+	FAST_NOISE_DLL_API extern void CancelNoiseJob(NoiseJob* job);
+	FAST_NOISE_DLL_API extern int WaitNoiseJob(NoiseJob* job);
+	FAST_NOISE_DLL_API extern float* TakeNoiseJobResult(NoiseJob* job, float* outMin, float* outMax);
+	FAST_NOISE_DLL_API extern void ReleaseNoiseJob(NoiseJob* job);
+}
+
+#endif
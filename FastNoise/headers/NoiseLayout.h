@@ -0,0 +1,28 @@
+#pragma once
+#ifndef NOISELAYOUT_H
+#define NOISELAYOUT_H
+#include "NoiseUtility.h"
+#include <stddef.h>
+
+//Edge of the bricks of LAYOUT_BRICKED, square for maps and cubic for volumes
+#define BRICK_2D 8
+#define BRICK_3D 4
+
+//ROW_MAJOR is x fastest, then y, then z. MORTON interleaves the bits of x, y (and z),
+//skipping an axis once its bits run out, and needs power of two sizes. BRICKED stores
+//whole bricks one after the other in row major order, row major inside a brick, with
+//the edge bricks padded.
+enum NoiseLayout { LAYOUT_ROW_MAJOR, LAYOUT_MORTON, LAYOUT_BRICKED };
+
+extern "C" {
+	//Floats needed for a map (sizeZ 0) or volume in a layout, 0 if the sizes don't fit it
+	FAST_NOISE_DLL_API extern size_t GetLayoutSize(int layout, int sizeX, int sizeY, int sizeZ);
+	//Position of sample x,y,z (z 0 and sizeZ 0 for maps)
+	FAST_NOISE_DLL_API extern size_t GetLayoutIndex(int layout, int x, int y, int z, int sizeX, int sizeY, int sizeZ);
+	//Sphere map written in layout order, result holds GetLayoutSize(layout, width, height, 0) floats
+	FAST_NOISE_DLL_API extern bool FillSphereSurfaceLayoutSIMD(float* result, const NoiseParams* params, int width, int height, int layout, float* outMin, float* outMax);
+	//Volume of samples at origin + (x,y,z)*spacing written in layout order
+	FAST_NOISE_DLL_API extern bool FillVolumeLayoutSIMD(float* result, const NoiseParams* params, float originX, float originY, float originZ, float spacing, int sizeX, int sizeY, int sizeZ, int layout, float* outMin, float* outMax);
+}
+
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+#ifndef NOISEQUEUE_H
+#define NOISEQUEUE_H
+#include "NoiseUtility.h"
+
+//Collects single point queries from any number of threads and evaluates them in
+//whole SIMD batches when the owner flushes, grouped by their settings
+typedef struct NoiseQueue NoiseQueue;
+
+//Called from FlushNoiseQueue once per query, in ticket order within each settings
+typedef void(*NoiseQueryCallback)(int64_t ticket, int settings, float value, void* userData);
+
+extern "C" {
+	//settingsCount parameter sets queries can refer to by index, and room for capacity
+	//queries between two flushes
+	FAST_NOISE_DLL_API extern NoiseQueue* CreateNoiseQueue(const NoiseParams* settings, int settingsCount, int capacity);
+	FAST_NOISE_DLL_API extern void DestroyNoiseQueue(NoiseQueue* queue);
+	//Lock free, from any thread. Returns the query's ticket, or -1 when the queue is full
+	//until the next flush or settings is not one of the queue's
+	FAST_NOISE_DLL_API extern int64_t EnqueueNoiseQuery(NoiseQueue* queue, float x, float y, float z, int settings);
+	//Evaluates every query enqueued before the call, calling callback (if any) for each.
+	//Only one thread may flush at a time, enqueueing can go on meanwhile. Returns the
+	//number of queries evaluated.
+	FAST_NOISE_DLL_API extern int FlushNoiseQueue(NoiseQueue* queue, NoiseQueryCallback callback, void* userData);
+	//Value of a query of the latest flush, false for tickets of any other flush
+	FAST_NOISE_DLL_API extern bool GetNoiseQueryResult(const NoiseQueue* queue, int64_t ticket, float* value);
+}
+
+#endif
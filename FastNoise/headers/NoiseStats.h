@@ -0,0 +1,60 @@
+#pragma once
+#ifndef NOISESTATS_H
+#define NOISESTATS_H
+#include "FastNoise.h"
+
+//Totals since the last ResetNoiseStats. Times are wall clock nanoseconds
+//summed over every thread. The counters are only filled in on Linux when
+//EnableNoiseCounters succeeded. They cover the scheduler's chunk tasks on every
+//thread that runs them, which includes the work of jobs and streams.
+typedef struct
+{
+	uint64_t calls;
+	uint64_t samples;
+	uint64_t octaves; //octaves evaluated, summed over samples
+	uint64_t allocationNs;
+	uint64_t setupNs; //function selection, trig tables and constants
+	uint64_t kernelNs;
+	uint64_t reductionNs;
+	double nsPerSample; //kernel time per sample
+	int countersValid;
+	uint64_t cycles;
+	uint64_t instructions;
+	uint64_t cacheMisses;
+} NoiseStats;
+
+enum NoisePhase { PHASE_ALLOCATION, PHASE_SETUP, PHASE_KERNEL, PHASE_REDUCTION };
+
+typedef void(*NoiseTraceCallback)(int phase, uint64_t ns, void* userData);
+
+extern "C" {
+	FAST_NOISE_DLL_API extern void GetNoiseStats(NoiseStats* stats);
+	FAST_NOISE_DLL_API extern void ResetNoiseStats();
+	FAST_NOISE_DLL_API extern bool EnableNoiseCounters(bool enable);
+	FAST_NOISE_DLL_API extern void SetNoiseTraceCallback(NoiseTraceCallback callback, void* userData);
+}
+
+uint64_t NoiseStatsNow();
+void NoiseStatsPhase(int phase, uint64_t ns);
+void NoiseStatsCount(uint64_t samples, uint64_t octaves);
+//Around every chunk task, counted on the thread that runs it
+void NoiseCountersBegin();
+void NoiseCountersEnd();
+
+//The generators only use these, so without NOISE_STATS they vanish completely
+#ifdef NOISE_STATS
+#define STATS_BEGIN(t) uint64_t t = NoiseStatsNow()
+#define STATS_END(t, phase) NoiseStatsPhase(phase, NoiseStatsNow() - (t))
+#define STATS_COUNT(samples, octaves) NoiseStatsCount(samples, octaves)
+#define STATS_COUNTERS_BEGIN() NoiseCountersBegin()
+#define STATS_COUNTERS_END() NoiseCountersEnd()
+#endif
+#ifndef NOISE_STATS
+#define STATS_BEGIN(t)
+#define STATS_END(t, phase)
+#define STATS_COUNT(samples, octaves)
+#define STATS_COUNTERS_BEGIN()
+#define STATS_COUNTERS_END()
+#endif
+
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+#ifndef NOISESTREAM_H
+#define NOISESTREAM_H
+#include "NoiseUtility.h"
+
+//Receives rows y0..y0+rows-1 of the map, width floats apart, in order and on the
+//calling thread. The buffer is reused once this returns, return false to stop.
+typedef bool(*NoiseBandSink)(const float* band, int y0, int rows, int width, void* userData);
+
+extern "C" {
+	//bandRows and ringSize <= 0 pick the scheduler grain and 3 buffers
+	FAST_NOISE_DLL_API extern bool StreamSphereSurfaceSIMD(const NoiseParams* params, int width, int height, int bandRows, int ringSize, NoiseBandSink sink, void* userData, float* outMin, float* outMax);
+	//Same, also gathering summary (see NoiseSummary.h) over the bands delivered
+	FAST_NOISE_DLL_API extern bool StreamSphereSurfaceSummarySIMD(const NoiseParams* params, int width, int height, int bandRows, int ringSize, NoiseBandSink sink, void* userData, NoiseSummary* summary);
+}
+
+#endif
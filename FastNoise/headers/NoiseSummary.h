@@ -0,0 +1,61 @@
+#pragma once
+#ifndef NOISESUMMARY_H
+#define NOISESUMMARY_H
+#include "FastNoise.h"
+#include <mutex>
+
+#define SUMMARY_MAX_BINS 65536
+
+//Statistics gathered while a map is generated. The caller sets bins (0 for no
+//histogram), the histogram range and array; the rest is filled in.
+typedef struct
+{
+	int bins;
+	float histogramMin;
+	float histogramMax;
+	uint64_t* histogram; //values outside the range are counted in the first or last bin
+	uint64_t count;
+	double sum;
+	double sumSquares;
+	float min;
+	float max;
+} NoiseSummary;
+
+extern "C" {
+	//Value below which fraction (0..1) of the samples lie, interpolated inside the histogram bin
+	FAST_NOISE_DLL_API extern float NoisePercentile(const NoiseSummary* summary, float fraction);
+	FAST_NOISE_DLL_API extern void NoiseMeanVariance(const NoiseSummary* summary, double* mean, double* variance);
+}
+
+//Histograms of a summary being generated, one per scheduler worker and one for the
+//calling thread. Each is allocated the first time its thread adds rows and they are
+//merged once at the end, so chunks neither clear nor merge a histogram of their own.
+struct SummaryThreads
+{
+	int count;
+	uint64_t** histograms;
+	//chunks of a thread past count, should the worker count change meanwhile
+	std::mutex lock;
+	uint64_t* overflow;
+};
+
+//Per chunk part of a summary, the generators fold every row they write into one
+//while it is still in cache. The histogram is the one of the thread running the chunk.
+//The sums of each row go back to the caller, which adds them in row order with
+//AddSummaryRows so they depend neither on the thread count nor on the grain.
+typedef struct
+{
+	uint64_t* histogram;
+	bool owned; //a histogram of its own, merged into overflow at the end of the chunk
+} SummaryPartial;
+
+bool BeginSummary(NoiseSummary* summary);
+void BeginSummaryThreads(SummaryThreads* threads, const NoiseSummary* summary);
+void BeginSummaryPartial(SummaryPartial* partial, const NoiseSummary* summary, SummaryThreads* threads);
+void SummarizeRow(SummaryPartial* partial, const NoiseSummary* summary, const float* row, int count, double* rowSum, double* rowSquares);
+void AddSummaryRows(NoiseSummary* summary, const double* rowSum, const double* rowSquares, int rows);
+void EndSummaryPartial(SummaryPartial* partial, const NoiseSummary* summary, SummaryThreads* threads);
+//Adds every thread's histogram to summary and frees them, a null summary only frees them
+void EndSummaryThreads(SummaryThreads* threads, NoiseSummary* summary);
+
+#endif
@@ -2,12 +2,146 @@
 #ifndef NOISEUTILITY_H
 #define NOISEUTILITY_H
 #include "FractalNoise3d.h"
+#include "NoiseSummary.h"
+
+//Full parameter set of a generator. The seed picks a translation of the noise
+//domain, seed 0 gives the same result as the functions without a seed.
+typedef struct
+{
+	int octaves;
+	float lacunarity;
+	float frequency;
+	float gain;
+	float offset;
+	int fractalType;
+	int noiseType;
+	int seed;
+	int quality; //NoiseQuality, left 0 it is the reference kernels
+} NoiseParams;
 
 extern "C" {
+	FAST_NOISE_DLL_API extern bool FillSphereSurfaceTileSIMD(float* result, const NoiseParams* params, int width, int height, int x0, int y0, int tileWidth, int tileHeight, float* outMin, float* outMax);
+	//Same, also gathering the statistics and histogram asked for by summary, min/max go to summary
+	FAST_NOISE_DLL_API extern bool FillSphereSurfaceTileSummarySIMD(float* result, const NoiseParams* params, int width, int height, int x0, int y0, int tileWidth, int tileHeight, NoiseSummary* summary);
 	FAST_NOISE_DLL_API extern float* GetSphereSurfaceNoiseSIMD(int width, int height, int octaves, float lacunarity, float frequency, float gain, float offset,int fractalType, int noiseType, float* outMin, float * outMax);
 	FAST_NOISE_DLL_API extern float* GetSphereSurfaceNoise(int width, int height, int octaves, float lacunarity, float frequency, float gain, float offset,int fractalType, int noiseType, float* outMin, float* outMax);
 	FAST_NOISE_DLL_API extern void CleanUpNoiseSIMD(float * resultArray);
 	FAST_NOISE_DLL_API extern void CleanUpNoise(float * resultArray);
 }
 
+
+//Helpers shared by the bulk generators, not part of the exported api
+
+//cos/sin of the longitude of every column of a sphere map, and the center
+//of the sphere in noise space
+typedef struct
+{
+	int width;
+	int height;
+	float* xcos;
+	float* ysin;
+	float originX;
+	float originY;
+	float originZ;
+} SphereTable;
+
+bool SelectFractalSIMD(int fractalType, int octaves, ISIMDFractal3d* fractalFunction);
+bool SelectNoiseSIMD(int noiseType, ISIMDNoise3d* noiseFunction, int quality = QUALITY_REFERENCE);
+//Multi vector kernels of the same fractal and noise
+bool SelectFractalSIMD(int fractalType, int octaves, ISIMDFractal3dN* fractalFunction);
+bool SelectNoiseSIMD(int noiseType, ISIMDNoise3dN* noiseFunction, int quality = QUALITY_REFERENCE);
+
+void InitSphereTable(SphereTable* T, int width, int height, int seed = 0);
+void FreeSphereTable(SphereTable* T);
+
+//Translation of the noise domain for a seed, zero for seed 0
+void SeedOffset(int seed, float* x, float* y, float* z);
+
+//Sets S->z for row y and returns sin(phi) for the row
+float SphereRowSIMD(Settings* S, const SphereTable* T, int y);
+
+//Fills S->x and S->y with columns x..x+VECTOR_SIZE-1, lanes at or past end
+//repeat the last column so they never disturb min/max
+inline void SphereVectorSIMD(Settings* S, const SphereTable* T, int x, int end, float sinPhi)
+{
+	for (int j = 0; j < VECTOR_SIZE; j++)
+	{
+		int c = x + j < end ? x + j : end - 1;
+		S->x.a[j] = T->xcos[c] * sinPhi + T->originX;
+		S->y.a[j] = T->ysin[c] * sinPhi + T->originY;
+	}
+}
+
+//Writes count (<= VECTOR_SIZE) lanes of v to out, which needs no alignment
+inline void StorePartial(float* out, SIMD v, int count)
+{
+	if (count == VECTOR_SIZE)
+	{
+		StoreU(out, v);
+		return;
+	}
+	uSIMD u;
+	u.m = v;
+	for (int j = 0; j < count; j++) out[j] = u.a[j];
+}
+
+//Evaluates columns x0..x1-1 of row y of a sphere map into out, folding them into min/max
+void FillSphereRowSIMD(float* out, const SphereTable* T, int y, int x0, int x1, Settings* S, ISIMDFractal3dN fractalFunction, ISIMDNoise3dN noiseFunction, SIMD* min, SIMD* max);
+
+//Running sum of a fractal built one octave at a time from raw noise, gives the
+//same result as the fractal functions picked by SelectFractalSIMD
+typedef struct
+{
+	SIMD out;
+	SIMD amplitude;
+	SIMD prev;
+	int fractalType;
+} FractalAccumulator;
+
+inline void BeginFractal(FractalAccumulator* A, int fractalType, int octaves)
+{
+	A->out = SetZero();
+	A->amplitude = SetOne(1.0f);
+	A->prev = SetOne(1.0f);
+	//single octaves fall back to plain, and abs of plain for ridge
+	if (octaves == 1 && fractalType != RIDGE) fractalType = PLAIN;
+	if (octaves == 1 && fractalType == RIDGE) fractalType = -RIDGE;
+	A->fractalType = fractalType;
+}
+
+inline void AddOctave(FractalAccumulator* A, SIMD r, SIMD gain, SIMD offset)
+{
+	switch (A->fractalType)
+	{
+	case FBM:
+		A->out = Add(A->out, Mul(A->amplitude, r));
+		break;
+	case TURBULENCE:
+		r = Mul(A->amplitude, r);
+		A->out = Add(A->out, Max(Sub(zero, r), r));
+		break;
+	case RIDGE:
+		r = Max(Sub(zero, r), r);
+		r = Sub(offset, r);
+		r = Mul(r, r);
+		r = Mul(r, A->amplitude);
+		r = Mul(r, A->prev);
+		A->out = Add(A->out, r);
+		A->prev = r;
+		break;
+	case -RIDGE:
+		A->out = Max(Sub(zero, r), r);
+		break;
+	default:
+		A->out = r;
+	}
+	A->amplitude = Mul(A->amplitude, gain);
+}
+
+//Horizontal min/max of the SIMD accumulators
+void ReduceMinMax(const SIMD* min, const SIMD* max, float* outMin, float* outMax);
+
+//Min/max over the partial results of every chunk of a ParallelFor
+void ReduceChunkMinMax(const float* chunkMin, const float* chunkMax, int chunks, float* outMin, float* outMax);
+
 #endif
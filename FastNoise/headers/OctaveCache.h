@@ -0,0 +1,36 @@
+#pragma once
+#ifndef OCTAVECACHE_H
+#define OCTAVECACHE_H
+#include "NoiseUtility.h"
+
+//Raw per octave noise is stored as half floats when F16C is available,
+//in DETERMINISTIC builds always as floats so every ISA tier gives the same result
+#if defined(F16C) && !defined(DETERMINISTIC)
+typedef uint16_t OctaveSample;
+#endif
+#if !defined(F16C) || defined(DETERMINISTIC)
+typedef float OctaveSample;
+#endif
+
+//Raw noise of every octave over a sphere map. The layers only depend on the
+//coordinates, frequency and lacunarity so any gain/offset/octave prefix can be
+//recombined from them without evaluating the noise again.
+typedef struct
+{
+	int width;
+	int height;
+	int octaves;
+	int blocks; //SIMD vectors per row
+	float frequency;
+	float lacunarity;
+	int noiseType;
+	OctaveSample* layers; //[row][block][octave][VECTOR_SIZE]
+} OctaveLayerCache;
+
+extern "C" {
+	FAST_NOISE_DLL_API extern OctaveLayerCache* GetSphereSurfaceOctaveLayersSIMD(int width, int height, int octaves, float lacunarity, float frequency, int noiseType);
+	FAST_NOISE_DLL_API extern float* CombineOctaveLayersSIMD(const OctaveLayerCache* cache, int octaves, float gain, float offset, int fractalType, float* outMin, float* outMax);
+	FAST_NOISE_DLL_API extern void CleanUpOctaveLayers(OctaveLayerCache* cache);
+}
+
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+#ifndef SPARSENOISE_H
+#define SPARSENOISE_H
+#include "NoiseUtility.h"
+
+//Called after every level of a progressive map with the stride just finished (1 for the
+//last) and min/max of the samples so far. Returning false stops before the next level.
+typedef bool(*NoiseProgressCallback)(const float* result, int stride, float min, float max, void* userData);
+
+extern "C" {
+	//Evaluates only the samples of a width x height sphere map whose bit is set in mask,
+	//bit i of mask[i / 32] for sample i = y*width + x. The other samples of result are
+	//left untouched, min/max cover the active samples.
+	FAST_NOISE_DLL_API extern bool FillSphereSurfaceMaskedSIMD(float* result, const NoiseParams* params, int width, int height, const uint32_t* mask, float* outMin, float* outMax);
+	//Same for count samples given as y*width + x indices, in any order
+	FAST_NOISE_DLL_API extern bool FillSphereSurfaceIndexedSIMD(float* result, const NoiseParams* params, int width, int height, const int* indices, int count, float* outMin, float* outMax);
+	//Sphere map in levels: every firstStride-th sample of every firstStride-th row, then the
+	//new samples of each halved stride down to 1, no sample evaluated twice. firstStride is
+	//a power of two. With fillGaps the samples of a level also cover the samples finer levels
+	//have yet to write, for a blocky preview. False when the callback stopped it early.
+	FAST_NOISE_DLL_API extern bool FillSphereSurfaceProgressiveSIMD(float* result, const NoiseParams* params, int width, int height, int firstStride, bool fillGaps, NoiseProgressCallback callback, void* userData, float* outMin, float* outMax);
+}
+
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+#include "FastNoise.h"
+
+//Rows per chunk when nothing else was configured
+#define DEFAULT_GRAIN 8
+
+extern "C" {
+	//0 uses one worker per hardware thread, takes effect when the workers next start
+	FAST_NOISE_DLL_API extern void SetSchedulerThreads(int threads);
+	FAST_NOISE_DLL_API extern int GetSchedulerThreads();
+	FAST_NOISE_DLL_API extern void SetSchedulerGrain(int rows);
+	FAST_NOISE_DLL_API extern int GetSchedulerGrain();
+	//Pins worker i to logical cpu i modulo the cpu count
+	FAST_NOISE_DLL_API extern void SetSchedulerAffinity(bool pin);
+}
+
+//Work for one chunk, rows begin..end-1, chunk is begin/grain
+typedef void(*ChunkTask)(void* context, int begin, int end, int chunk);
+typedef void(*BatchDone)(void* context);
+
+//Number of chunks count rows are split into
+int ChunkCount(int count, int grain);
+
+//0..GetSchedulerThreads()-1 on a worker, -1 on any other thread
+int SchedulerWorkerIndex();
+
+//Runs task over 0..count-1 in chunks of grain rows spread over the workers and
+//returns when all of them are done. The calling thread works on them too (and on
+//nothing else), so this may be called from inside another task.
+void ParallelFor(int count, int grain, ChunkTask task, void* context);
+
+//Same without waiting, done runs on the worker that finished the last chunk
+void SubmitParallelFor(int count, int grain, ChunkTask task, void* context, BatchDone done);
+
+//Runs one still queued chunk of a batch submitted with context on the calling
+//thread, false if there is none. A thread waiting on its SubmitParallelFor work
+//calls this until it fails before it sleeps, so the work can't be stuck behind it.
+//done then runs on the calling thread if it finishes the last chunk.
+bool RunQueuedChunk(const void* context);
+
+//Stops the workers so the next batch starts them again with the current thread
+//count. Only while nothing is queued.
+void RestartScheduler();
+
+#endif
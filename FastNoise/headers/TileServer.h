@@ -0,0 +1,61 @@
+#pragma once
+#ifndef TILESERVER_H
+#define TILESERVER_H
+#include "NoiseCache.h"
+
+//Serves sphere map tiles to other processes on the same host over a Unix domain socket.
+//Tiles are generated into memfd segments that clients map read only, so every process
+//shares the one copy the server keeps in its cache. Linux only, elsewhere the functions
+//fail.
+
+#define TILE_SERVER_SOCKET "/tmp/fastnoise.sock"
+#define TILE_SERVER_MAGIC 0x52534E46 //"FNSR"
+#define TILE_SERVER_VERSION 2
+//Largest tile served, in samples (16MB of floats), and largest map width or height. Tiles
+//are generated one at a time, so this bounds how long one request keeps the others
+//waiting; larger areas are asked for as several tiles.
+#define TILE_SERVER_MAX_SAMPLES (1 << 22)
+#define TILE_SERVER_MAX_SIDE (1 << 20)
+//Requests for more octaves are refused
+#define TILE_SERVER_MAX_OCTAVES 32
+
+//A request is one TileServerRequest, answered by one TileServerReply carrying the
+//segment's file descriptor (SCM_RIGHTS) when status is TILE_SERVED
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	NoiseCacheKey key; //zero filled apart from the fields, like the cache's keys
+} TileServerRequest;
+
+enum TileServerStatus { TILE_SERVED, TILE_BAD_REQUEST, TILE_FAILED };
+
+typedef struct
+{
+	uint32_t magic;
+	int32_t status;
+	float min;
+	float max;
+	uint64_t bytes; //tileWidth*tileHeight floats, row major
+} TileServerReply;
+
+typedef struct TileServer TileServer;
+typedef struct TileClient TileClient;
+
+extern "C" {
+	//Listens on socketPath from a background thread, keeping up to cacheBytes of tiles. The
+	//socket is created owner only (0600). A socket file left by a server that is gone is
+	//replaced; anything else at socketPath, a running server's socket included, makes it
+	//fail.
+	FAST_NOISE_DLL_API extern TileServer* StartTileServer(const char* socketPath, size_t cacheBytes);
+	FAST_NOISE_DLL_API extern void StopTileServer(TileServer* server);
+
+	FAST_NOISE_DLL_API extern TileClient* ConnectTileServer(const char* socketPath);
+	FAST_NOISE_DLL_API extern void DisconnectTileServer(TileClient* client);
+	//Same arguments as FillSphereSurfaceTileSIMD, returns the tile mapped read only, to be
+	//handed back with ReleaseServedTile. One request at a time per client.
+	FAST_NOISE_DLL_API extern const float* RequestSphereSurfaceTile(TileClient* client, const NoiseParams* params, int width, int height, int x0, int y0, int tileWidth, int tileHeight, float* outMin, float* outMax);
+	FAST_NOISE_DLL_API extern void ReleaseServedTile(const float* tile, int tileWidth, int tileHeight);
+}
+
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+#ifndef VARYINGFRACTAL_H
+#define VARYINGFRACTAL_H
+#include "NoiseUtility.h"
+
+//Upper limit of the per sample octave count
+#define VARYING_MAX_OCTAVES 24
+
+//VARY_CONSTANT takes the value of the NoiseParams, VARY_BUFFER one value per sample from
+//a buffer, VARY_NOISE a value driven by a secondary (usually low frequency) noise
+enum VaryingSource { VARY_CONSTANT, VARY_BUFFER, VARY_NOISE };
+
+//One fractal parameter that can change across the map
+typedef struct
+{
+	int source;
+	const float* buffer; //VARY_BUFFER: width x height values, row major over the whole map
+	NoiseParams noise; //VARY_NOISE: evaluated at the same points, its own seed included
+	float low; //VARY_NOISE: value where the noise is -1
+	float high; //and where it is 1, clamped in between
+} VaryingParam;
+
+typedef struct
+{
+	VaryingParam frequency;
+	VaryingParam gain;
+	VaryingParam offset;
+	VaryingParam octaves; //fractional, the last octave is weighted by the fraction
+} VaryingFractalParams;
+
+extern "C" {
+	//FillSphereSurfaceTileSIMD with frequency, gain, offset and the octave count read per
+	//sample, evaluated inside the octave loop in one pass. Lacunarity, fractal and noise type
+	//and seed come from params. With every parameter constant the result is the same as
+	//FillSphereSurfaceTileSIMD. With a varying octave count, turbulence and ridge keep their
+	//multi octave form where the count is one or less, while the dense path (and a constant
+	//count of one) switches to plain signed noise and |n|.
+	FAST_NOISE_DLL_API extern bool FillSphereSurfaceVaryingSIMD(float* result, const NoiseParams* params, const VaryingFractalParams* varying, int width, int height, int x0, int y0, int tileWidth, int tileHeight, float* outMin, float* outMax);
+}
+
+#endif
@@ -0,0 +1,36 @@
+//Standalone tile server: NoiseServer [socket path] [cache megabytes]
+#include "..\FastNoise\headers\TileServer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef __linux__
+#include <signal.h>
+#endif
+
+int main(int argc, char** argv)
+{
+#ifdef __linux__
+	const char* path = argc > 1 ? argv[1] : TILE_SERVER_SOCKET;
+	size_t megabytes = argc > 2 ? (size_t)atol(argv[2]) : 512;
+	//the signals are taken with sigwait, blocked before any thread starts so none of them gets one
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, 0);
+	TileServer* server = StartTileServer(path, megabytes * 1024 * 1024);
+	if (!server)
+	{
+		fprintf(stderr, "can't listen on %s\n", path);
+		return 1;
+	}
+	printf("serving tiles on %s, %d MB cache\n", path, (int)megabytes);
+	int signal;
+	sigwait(&signals, &signal);
+	StopTileServer(server);
+	return 0;
+#endif
+#ifndef __linux__
+	fprintf(stderr, "the tile server needs Linux\n");
+	return 1;
+#endif
+}